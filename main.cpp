@@ -5,11 +5,23 @@
 #include <filesystem> 
 #include <fstream>
 #include <chrono>   // 用於效能計時
+#include <map>
+#include <sstream>
+#include <random>   // selftest 的預設 seed
+#include <cstdlib>  // 命令列參數轉數字
+#include <cerrno>
+#include <climits>
 
 // 引入 modules 資料夾下的標頭檔
 #include "modules/SHA256.h"
 #include "modules/rsa.hpp"
 #include "modules/serpent.hpp"
+#include "modules/mapped_file.hpp"
+#include "modules/HMACSHA256.h"
+#include "modules/SHA256Multi.h"
+#include "modules/bulk_crypt.hpp"
+#include "modules/bench_suite.hpp"
+#include "modules/metrics.hpp"
 
 using namespace std;
 namespace fs = std::filesystem;
@@ -17,9 +29,10 @@ namespace fs = std::filesystem;
 // --- 設定資料夾常數 ---
 const string DATA_DIR = "data/";      
 const string MODULE_DIR = "modules/"; 
-const string DEFAULT_KEY_FILE = "rsa_keypair.txt"; // 預設檔名
+const string DEFAULT_KEY_FILE = "rsa_keypair.key"; // 預設檔名 (二進位格式)
 
 static RSAKey globalRSAKey;
+static RSAContext globalRSAContext; // 由 globalRSAKey 預先建立，加解密都用這個
 static bool hasKey = false; 
 
 // --- 輔助：確保 data 資料夾存在 ---
@@ -53,68 +66,516 @@ void listDataFiles() {
 }
 
 // --- 成員 D 負責：SHA-256 檔案雜湊功能 ---
-void hashFile(string filePath) {
+// 優先以 mmap 直接從 page cache 雜湊，無法映射 (空檔案或 Windows 等不支援的平台) 時
+// 改用 ifstream 以固定 1 MiB 的 buffer 分段讀入，兩種路徑都不配置與檔案等大的記憶體
+bool sha256File(const string& fullPath, std::array<uint8_t, 32>& digest, uint64_t& size) {
     SHA256 sha;
+    MappedFile mapped;
+    size = 0;
+
+    if (mapped.openRead(fullPath)) {
+        size = mapped.size();
+        sha.update(mapped.data(), size);
+    } else {
+        ifstream file(fullPath, ios::binary);
+        if (!file.is_open()) return false;
+
+        vector<char> buffer(1 << 20);
+        while (file.read(buffer.data(), buffer.size()) || file.gcount() > 0) {
+            sha.update(reinterpret_cast<const uint8_t*>(buffer.data()), static_cast<size_t>(file.gcount()));
+            size += static_cast<uint64_t>(file.gcount());
+        }
+        if (file.bad()) return false;
+    }
+
+    digest = sha.digest();
+    return true;
+}
+
+// 多個檔案一起雜湊 (hash 指令)：不超過 SHA256Multi::MAX_PENDING 的小檔案每 64 個一批，
+// 各放進 SHA256Multi 的一個 lane，一次以 SIMD 壓縮 4 / 8 / 16 個檔案；
+// 大檔案，或 multi-buffer 不比單一 SHA256 快的 CPU (SHA256Multi::fasterThanSingle)，逐一用 sha256File。
+// 結果依 paths 的順序放在 digests，ok[i] = false 代表檔案無法讀取
+void sha256Files(const vector<string>& paths, vector<std::array<uint8_t, 32>>& digests, vector<bool>& ok) {
+    const size_t BATCH = 64;
+    digests.assign(paths.size(), std::array<uint8_t, 32>());
+    ok.assign(paths.size(), false);
+
+    vector<size_t> small;
+    for (size_t i = 0; i < paths.size(); i++) {
+        error_code ec;
+        uint64_t size = fs::file_size(paths[i], ec);
+        if (!ec && size <= SHA256Multi::MAX_PENDING && SHA256Multi::fasterThanSingle()) {
+            small.push_back(i);
+        } else {
+            uint64_t ignored = 0;
+            ok[i] = sha256File(paths[i], digests[i], ignored);
+        }
+    }
+
+    for (size_t first = 0; first < small.size(); first += BATCH) {
+        const size_t count = min(BATCH, small.size() - first);
+        SHA256Multi multi(count);
+        for (size_t lane = 0; lane < count; lane++) {
+            const string& path = paths[small[first + lane]];
+            MappedFile mapped;
+            if (mapped.openRead(path)) {
+                multi.update(lane, mapped.data(), mapped.size());
+                ok[small[first + lane]] = true;
+                continue;
+            }
+            // 空檔案無法映射，改用 ifstream
+            ifstream file(path, ios::binary);
+            vector<char> buffer((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+            multi.update(lane, reinterpret_cast<const uint8_t*>(buffer.data()), buffer.size());
+            ok[small[first + lane]] = file.is_open() && !file.bad();
+        }
+        vector<std::array<uint8_t, 32>> batch = multi.digestAll();
+        for (size_t lane = 0; lane < count; lane++) digests[small[first + lane]] = batch[lane];
+    }
+}
+
+void hashFile(string filePath) {
     // 考慮到 main 的 DATA_DIR，這裡補上路徑
     string fullPath = DATA_DIR + filePath;
-    ifstream file(fullPath, ios::binary | ios::ate); 
+    std::array<uint8_t, 32> digest;
+    uint64_t size = 0;
 
-    if (!file.is_open()) {
+    auto start = chrono::high_resolution_clock::now();
+
+    if (!sha256File(fullPath, digest, size)) {
         cout << "[錯誤] 無法開啟檔案: " << fullPath << "，請確認檔案存在於 data/ 資料夾中。" << endl;
         return;
     }
 
-    streamsize size = file.tellg();
-    file.seekg(0, ios::beg);
-
-    vector<char> buffer(size);
-    if (file.read(buffer.data(), size)) {
-        auto start = chrono::high_resolution_clock::now();
+    auto end = chrono::high_resolution_clock::now();
+    chrono::duration<double, milli> elapsed = end - start;
 
-        sha.update(reinterpret_cast<const uint8_t*>(buffer.data()), size);
-        std::array<uint8_t, 32> digest = sha.digest();
+    cout << "\n--- SHA-256 完整性檢查結果 ---" << endl;
+    cout << "檔案名稱: " << filePath << endl;
+    cout << "檔案大小: " << size << " bytes" << endl;
+    cout << "雜湊值  : " << SHA256::toString(digest) << endl;
+    cout << "運算耗時: " << elapsed.count() << " ms" << endl;
+    cout << "------------------------------" << endl;
+}
 
-        auto end = chrono::high_resolution_clock::now();
-        chrono::duration<double, milli> elapsed = end - start;
+// --- 功能：RSA 批次解密效能測試 ---
+// 以目前載入的金鑰包裝一批隨機 session key，比較逐一 rsa_decrypt 與 rsa_decrypt_batch 的速度
+void benchmarkRSADecrypt() {
+    const size_t COUNT = 2000;
+    cout << "\n[系統] 準備 " << COUNT << " 個被包裝的 Session Key..." << endl;
 
-        cout << "\n--- SHA-256 完整性檢查結果 ---" << endl;
-        cout << "檔案名稱: " << filePath << endl;
-        cout << "檔案大小: " << size << " bytes" << endl;
-        cout << "雜湊值  : " << SHA256::toString(digest) << endl;
-        cout << "運算耗時: " << elapsed.count() << " ms" << endl;
-        cout << "------------------------------" << endl;
+    vector<mpz_class> sessionKeys(COUNT), wrapped(COUNT);
+    for (size_t i = 0; i < COUNT; i++) {
+        sessionKeys[i] = random_bits(256);
+        wrapped[i] = rsa_encrypt(sessionKeys[i], globalRSAContext);
     }
+
+    auto start = chrono::high_resolution_clock::now();
+    vector<mpz_class> single(COUNT);
+    for (size_t i = 0; i < COUNT; i++) single[i] = rsa_decrypt(wrapped[i], globalRSAContext);
+    auto mid = chrono::high_resolution_clock::now();
+    vector<mpz_class> batch = rsa_decrypt_batch(wrapped, globalRSAContext);
+    auto end = chrono::high_resolution_clock::now();
+
+    double singleSec = chrono::duration<double>(mid - start).count();
+    double batchSec  = chrono::duration<double>(end - mid).count();
+    bool ok = (single == sessionKeys) && (batch == sessionKeys);
+
+    cout << "\n--- RSA 解密效能 (" << globalRSAContext.bits << " bits, "
+         << (globalRSAContext.crt ? "CRT" : "無 CRT") << ") ---" << endl;
+    cout << "逐一 rsa_decrypt   : " << COUNT / singleSec << " ops/sec" << endl;
+    cout << "rsa_decrypt_batch  : " << COUNT / batchSec << " ops/sec" << endl;
+    cout << "結果驗證           : " << (ok ? "一致" : "不一致！") << endl;
+    cout << "------------------------------" << endl;
 }
 
-// --- 功能：儲存 RSA 金鑰 (支援自訂檔名) ---
-void saveRSAKey(const string& filename) {
-    string fullPath = DATA_DIR + filename;
-    ofstream fout(fullPath);
-    if (fout) {
-        fout << globalRSAKey.n << endl;
-        fout << globalRSAKey.e << endl;
-        fout << globalRSAKey.d << endl;
+// --- 功能：儲存 RSA 金鑰 (支援自訂檔名，二進位格式) ---
+bool saveRSAKeyTo(const string& fullPath) {
+    if (rsa_save_key(fullPath, globalRSAKey)) {
         cout << "[系統] RSA 金鑰已儲存至: " << fullPath << endl;
-    } else {
-        cerr << "[錯誤] 無法寫入檔案！" << endl;
+        return true;
     }
+    cerr << "[錯誤] 無法寫入檔案！" << endl;
+    return false;
 }
 
-// --- 功能：指定檔名讀取 RSA 金鑰 ---
-bool loadRSAKey(const string& filename) {
-    string fullPath = DATA_DIR + filename;
-    ifstream fin(fullPath);
-    if (!fin) return false;
-
-    fin >> globalRSAKey.n >> globalRSAKey.e >> globalRSAKey.d;
-    
-    if (fin.fail()) return false;
-    
+void saveRSAKey(const string& filename) {
+    saveRSAKeyTo(DATA_DIR + filename);
+}
+
+// --- 功能：指定路徑讀取 RSA 金鑰 (自動辨識二進位 / 舊版文字格式) ---
+bool loadRSAKeyFrom(const string& fullPath) {
+    RSAKey key;
+    if (!rsa_load_key(fullPath, key)) return false;
+
+    // 舊版 3 行金鑰沒有 CRT 參數；不一致的 CRT 參數已由 rsa_load_key 清掉，兩者都退回不使用 CRT
+    globalRSAKey = key;
+    globalRSAContext = rsa_context(key);
     hasKey = true;
     return true;
 }
 
-int main() {
+bool loadRSAKey(const string& filename) {
+    return loadRSAKeyFrom(DATA_DIR + filename);
+}
+
+// --- 混合加密 / 解密 (選單與命令列共用) ---
+// threads = 0 代表使用全部核心；chunkSize 為 Serpent 串流處理的單位
+struct CipherOptions {
+    unsigned threads = 0;
+    size_t chunkSize = Serpent::DEFAULT_CHUNK_SIZE;
+};
+
+// 產生隨機 Session Key，以目前的 RSA 公鑰包裝後寫進容器標頭 (CTR + HMAC)
+bool hybridEncrypt(const string& inPath, const string& outPath, const CipherOptions& opt,
+                   SHA256* plainHash, SHA256* cipherHash) {
+    cout << "[1/2] 生成並保護 Session Key..." << endl;
+    mpz_class sessionKey = random_bits(256);
+    mpz_class encKey = rsa_encrypt(sessionKey, globalRSAContext);
+
+    // 包裝後的 Session Key 直接寫進加密檔的標頭，不再另存 session.key
+    cout << "[2/2] Serpent 加密..." << endl;
+    Serpent cipher;
+    cipher.setMode(Serpent::Mode::CTR);
+    cipher.setLayout(Serpent::Layout::Standard);
+    cipher.setAuthenticated(true); // 加密時一併計算 HMAC-SHA256，解密時驗證
+    cipher.setThreadCount(opt.threads);
+    cipher.setChunkSize(opt.chunkSize);
+    cipher.setKey(sessionKey);
+    return cipher.encryptFile(inPath, outPath, rsa_mpz_to_bytes(encKey), plainHash, cipherHash);
+}
+
+// 容器檔從標頭取出包裝金鑰；舊版檔案使用 legacyKeyPath 指定的 session.key
+bool hybridDecrypt(const string& inPath, const string& outPath, const string& legacyKeyPath,
+                   const CipherOptions& opt, SHA256* plainHash) {
+    mpz_class wrappedKey;
+    if (Serpent::isContainer(inPath)) {
+        Serpent::ContainerHeader header;
+        if (!Serpent::readContainerHeader(inPath, header)) {
+            cout << "[錯誤] 加密檔標頭損毀或版本不支援！" << endl;
+            return false;
+        }
+        wrappedKey = rsa_mpz_from_bytes(header.wrappedKey);
+    } else if (legacyKeyPath.empty() || !rsa_load_wrapped_key(legacyKeyPath, wrappedKey)) {
+        cout << "找不到金鑰檔或格式錯誤！" << endl;
+        return false;
+    }
+
+    mpz_class sessionKey;
+    try {
+        sessionKey = rsa_decrypt(wrappedKey, globalRSAContext);
+    } catch (const exception& e) {
+        cout << "[失敗] 無法解開 Session Key (金鑰不符？): " << e.what() << endl;
+        return false;
+    }
+
+    cout << "[1/1] Serpent 解密..." << endl;
+    Serpent cipher;
+    cipher.setThreadCount(opt.threads);
+    cipher.setChunkSize(opt.chunkSize);
+    cipher.setKey(sessionKey);
+    return cipher.decryptFile(inPath, outPath, plainHash);
+}
+
+// =========================================================
+//  命令列模式 (有參數時不進入選單，方便寫成批次腳本)
+// =========================================================
+// --- 命令列數值上限 ---
+const unsigned long MAX_THREADS = 1024;          // --threads (0 代表預設值)
+const unsigned long MAX_RSA_BITS = 16384;        // --bits / --rsa-bits
+const unsigned long MAX_SELFTEST_BLOCKS = 1UL << 24;
+const unsigned long MAX_BENCH_MILLIS = 600000;
+
+void printUsage(const char* prog) {
+    cout << "用法:\n"
+         << "  " << prog << "                     進入互動式選單\n"
+         << "  " << prog << " keygen  [--bits N] [--out 金鑰檔]\n"
+         << "  " << prog << " encrypt --in 原始檔 --out 加密檔 [--key 金鑰檔] [--threads N] [--chunk BYTES]\n"
+         << "  " << prog << " decrypt --in 加密檔 --out 還原檔 [--key 金鑰檔] [--session 舊版session.key]\n"
+         << "                    [--threads N] [--chunk BYTES]\n"
+         << "  " << prog << " encrypt-dir --in 來源目錄 --out 輸出目錄 [--key 金鑰檔] [--threads N] [--chunk BYTES]\n"
+         << "  " << prog << " decrypt-dir --in 加密目錄 --out 還原目錄 [--key 金鑰檔] [--threads N] [--chunk BYTES]\n"
+         << "                    [--report 報表.tsv]\n"
+         << "  " << prog << " hash    檔案...\n"
+         << "  " << prog << " bench   [--key 金鑰檔 | --bits N]\n"
+         << "  " << prog << " selftest [--blocks N] [--seed N] [--bits N]\n"
+         << "  " << prog << " bench-suite [--out 結果.json] [--millis MS] [--rsa-bits 1024,2048,4096] [--threads N]\n"
+         << "數值範圍: --threads 0~" << MAX_THREADS << " (0 為硬體執行緒數), --chunk 16~" << Serpent::MAX_CHUNK_SIZE
+         << ", --bits / --rsa-bits " << RSA_MIN_BITS << "~" << MAX_RSA_BITS << "\n"
+         << "任何指令都可以加上 --metrics 檔案，結束時把各階段的耗時與 bytes 寫成 Prometheus 文字格式\n"
+         << "路徑皆相對於目前目錄；金鑰檔預設為 " << DATA_DIR << DEFAULT_KEY_FILE << "\n"
+         << "結束碼: 0 成功, 1 執行失敗, 2 參數錯誤" << endl;
+}
+
+// 解析 "--名稱 值" 形式的參數，其餘當作位置參數；缺少值時回傳 false
+bool parseArgs(int argc, char* argv[], int start, map<string, string>& flags, vector<string>& positional) {
+    for (int i = start; i < argc; i++) {
+        string arg = argv[i];
+        if (arg.size() > 2 && arg.compare(0, 2, "--") == 0) {
+            if (i + 1 >= argc) {
+                cerr << "[錯誤] 參數 " << arg << " 缺少數值" << endl;
+                return false;
+            }
+            flags[arg.substr(2)] = argv[++i];
+        } else {
+            positional.push_back(arg);
+        }
+    }
+    return true;
+}
+
+// 十進位非負整數且落在 [min, max]；不接受正負號、空白與溢位 (strtoul 會把 "-1" 轉成 ULONG_MAX)
+bool parseNumber(const string& text, unsigned long min, unsigned long max, unsigned long& value) {
+    if (text.empty() || text[0] < '0' || text[0] > '9') return false;
+    char* end = nullptr;
+    errno = 0;
+    unsigned long v = strtoul(text.c_str(), &end, 10);
+    if (*end != '\0' || errno == ERANGE || v < min || v > max) return false;
+    value = v;
+    return true;
+}
+
+// 讀取整數參數，未指定時回傳 def；格式錯誤或超出 [min, max] 時 ok = false
+unsigned long flagNumber(const map<string, string>& flags, const string& name, unsigned long def,
+                         unsigned long min, unsigned long max, bool& ok) {
+    auto it = flags.find(name);
+    if (it == flags.end()) return def;
+    unsigned long v = def;
+    if (!parseNumber(it->second, min, max, v)) {
+        cerr << "[錯誤] --" << name << " 必須是介於 " << min << " 與 " << max << " 之間的整數: " << it->second << endl;
+        ok = false;
+    }
+    return v;
+}
+
+string flagString(const map<string, string>& flags, const string& name, const string& def) {
+    auto it = flags.find(name);
+    return it == flags.end() ? def : it->second;
+}
+
+// 執行單一指令，回傳結束碼
+int runCommand(const string& cmd, map<string, string>& flags, const vector<string>& positional, const char* prog) {
+    bool ok = true;
+    CipherOptions opt;
+    opt.threads = flagNumber(flags, "threads", 0, 0, MAX_THREADS, ok);
+    opt.chunkSize = flagNumber(flags, "chunk", Serpent::DEFAULT_CHUNK_SIZE, 16, Serpent::MAX_CHUNK_SIZE, ok);
+    unsigned long bits = flagNumber(flags, "bits", 1024, RSA_MIN_BITS, MAX_RSA_BITS, ok);
+    string keyPath = flagString(flags, "key", DATA_DIR + DEFAULT_KEY_FILE);
+    string inPath = flagString(flags, "in", "");
+    string outPath = flagString(flags, "out", "");
+    if (!ok) return 2;
+
+    if (cmd == "keygen") {
+        if (outPath.empty()) outPath = DATA_DIR + DEFAULT_KEY_FILE;
+        try {
+            globalRSAKey = rsa_keygen(bits);
+            globalRSAContext = rsa_context(globalRSAKey);
+        } catch (const exception& e) {
+            cerr << "[失敗] " << e.what() << endl;
+            return 1;
+        }
+        return saveRSAKeyTo(outPath) ? 0 : 1;
+    }
+
+    if (cmd == "encrypt" || cmd == "decrypt") {
+        if (inPath.empty() || outPath.empty()) {
+            cerr << "[錯誤] " << cmd << " 需要 --in 與 --out" << endl;
+            return 2;
+        }
+        if (!loadRSAKeyFrom(keyPath)) {
+            cerr << "[錯誤] 無法載入金鑰: " << keyPath << endl;
+            return 1;
+        }
+
+        SHA256 plainHash;
+        if (cmd == "encrypt") {
+            if (!hybridEncrypt(inPath, outPath, opt, &plainHash, nullptr)) return 1;
+        } else {
+            if (!hybridDecrypt(inPath, outPath, flagString(flags, "session", ""), opt, &plainHash)) return 1;
+        }
+        cout << SHA256::toString(plainHash.digest()) << "  " << (cmd == "encrypt" ? inPath : outPath) << endl;
+        return 0;
+    }
+
+    if (cmd == "encrypt-dir" || cmd == "decrypt-dir") {
+        if (inPath.empty() || outPath.empty()) {
+            cerr << "[錯誤] " << cmd << " 需要 --in 與 --out" << endl;
+            return 2;
+        }
+        if (!loadRSAKeyFrom(keyPath)) {
+            cerr << "[錯誤] 無法載入金鑰: " << keyPath << endl;
+            return 1;
+        }
+
+        BulkOptions bulkOpt;
+        bulkOpt.threads = opt.threads;
+        bulkOpt.chunkSize = opt.chunkSize;
+        BulkReport report = (cmd == "encrypt-dir")
+            ? bulkEncryptDirectory(inPath, outPath, globalRSAContext, bulkOpt)
+            : bulkDecryptDirectory(inPath, outPath, globalRSAContext, bulkOpt);
+
+        for (const BulkFileResult& r : report.files) {
+            if (r.status == BulkFileResult::Status::Failed) {
+                cerr << "[失敗] " << r.path << ": " << r.message << endl;
+            }
+        }
+        string reportPath = flagString(flags, "report", "");
+        if (!reportPath.empty() && !report.write(reportPath)) {
+            cerr << "[錯誤] 無法寫入報表: " << reportPath << endl;
+        }
+
+        double mb = report.bytes / (1024.0 * 1024.0);
+        cout << "成功 " << report.ok << " / 失敗 " << report.failed << " / 略過 " << report.skipped
+             << "，共 " << mb << " MB，" << report.seconds << " 秒";
+        if (report.seconds > 0) {
+            cout << " (" << mb / report.seconds << " MB/s, " << report.ok / report.seconds << " 檔/秒)";
+        }
+        cout << endl;
+        return report.failed == 0 ? 0 : 1;
+    }
+
+    if (cmd == "hash") {
+        if (positional.empty()) {
+            cerr << "[錯誤] hash 需要至少一個檔案" << endl;
+            return 2;
+        }
+        // 輸出格式與 sha256sum 相同
+        vector<std::array<uint8_t, 32>> digests;
+        vector<bool> hashed;
+        sha256Files(positional, digests, hashed);
+        int status = 0;
+        for (size_t i = 0; i < positional.size(); i++) {
+            if (!hashed[i]) {
+                cerr << "[錯誤] 無法開啟檔案: " << positional[i] << endl;
+                status = 1;
+                continue;
+            }
+            cout << SHA256::toString(digests[i]) << "  " << positional[i] << endl;
+        }
+        return status;
+    }
+
+    if (cmd == "bench") {
+        if (flags.count("key")) {
+            if (!loadRSAKeyFrom(keyPath)) {
+                cerr << "[錯誤] 無法載入金鑰: " << keyPath << endl;
+                return 1;
+            }
+        } else {
+            try {
+                globalRSAKey = rsa_keygen(bits);
+                globalRSAContext = rsa_context(globalRSAKey);
+            } catch (const exception& e) {
+                cerr << "[失敗] " << e.what() << endl;
+                return 1;
+            }
+        }
+        benchmarkRSADecrypt();
+        return 0;
+    }
+
+    if (cmd == "selftest") {
+        // 已知答案 + 各加速 backend 對照 scalar 的差分測試；任何一項失敗回傳 1
+        unsigned long blocks = flagNumber(flags, "blocks", 1UL << 20, 1, MAX_SELFTEST_BLOCKS, ok);
+        unsigned long seed = flagNumber(flags, "seed", random_device{}(), 0, ULONG_MAX, ok);
+        if (!ok) return 2;
+        cout << "seed = " << seed << endl;
+
+        bool passed = true;
+        for (Serpent::Layout layout : { Serpent::Layout::Legacy, Serpent::Layout::Standard }) {
+            Serpent cipher;
+            cipher.setLayout(layout);
+            passed = cipher.runComponentTest() && passed;
+        }
+        passed = Serpent::runKnownAnswerTest() && passed;
+        passed = Serpent::runDifferentialTest(blocks, seed) && passed;
+        passed = Serpent::runContainerTest(seed) && passed;
+        passed = SHA256::runKnownAnswerTest() && passed;
+        passed = SHA256::runDifferentialTest(16ULL * blocks, seed) && passed;
+        passed = SHA256Multi::runDifferentialTest(blocks / 64 + 1, seed) && passed;
+        passed = HMACSHA256::runKnownAnswerTest() && passed;
+        try {
+            passed = rsa_self_test(bits, 64) && passed;
+        } catch (const exception& e) {
+            cerr << "[FAIL] RSA: " << e.what() << endl;
+            passed = false;
+        }
+
+        cout << (passed ? "全部測試通過" : "有測試失敗！") << endl;
+        return passed ? 0 : 1;
+    }
+
+    if (cmd == "bench-suite") {
+        BenchOptions benchOpt;
+        benchOpt.threads = opt.threads;
+        benchOpt.minSeconds = flagNumber(flags, "millis", 500, 1, MAX_BENCH_MILLIS, ok) / 1000.0;
+        if (flags.count("rsa-bits")) {
+            benchOpt.rsaBits.clear();
+            stringstream list(flags["rsa-bits"]);
+            string item;
+            while (getline(list, item, ',')) {
+                unsigned long v = 0;
+                if (!parseNumber(item, RSA_MIN_BITS, MAX_RSA_BITS, v)) {
+                    cerr << "[錯誤] --rsa-bits 的每一項必須是介於 " << RSA_MIN_BITS << " 與 " << MAX_RSA_BITS
+                         << " 之間的整數: " << flags["rsa-bits"] << endl;
+                    return 2;
+                }
+                benchOpt.rsaBits.push_back(v);
+            }
+        }
+        if (!ok) return 2;
+
+        // JSON 寫到檔案 (或標準輸出)，進度訊息寫到標準錯誤，不會混進 JSON
+        bool written;
+        if (outPath.empty()) {
+            written = runBenchSuite(benchOpt, cout, &cerr);
+        } else {
+            ofstream json(outPath);
+            if (!json) {
+                cerr << "[錯誤] 無法寫入檔案: " << outPath << endl;
+                return 1;
+            }
+            written = runBenchSuite(benchOpt, json, &cerr) && static_cast<bool>(json);
+        }
+        return written ? 0 : 1;
+    }
+
+    cerr << "[錯誤] 未知的指令: " << cmd << endl;
+    printUsage(prog);
+    return 2;
+}
+
+int runCommandLine(int argc, char* argv[]) {
+    string cmd = argv[1];
+    if (cmd == "help" || cmd == "-h" || cmd == "--help") { printUsage(argv[0]); return 0; }
+
+    map<string, string> flags;
+    vector<string> positional;
+    if (!parseArgs(argc, argv, 2, flags, positional)) return 2;
+
+    // --metrics 檔案：開啟各階段的計時與直方圖，指令結束後寫成 Prometheus 文字格式
+    string metricsPath = flagString(flags, "metrics", "");
+    if (!metricsPath.empty()) Metrics::setEnabled(true);
+
+    int status = runCommand(cmd, flags, positional, argv[0]);
+
+    if (!metricsPath.empty() && !Metrics::writePrometheus(metricsPath)) {
+        cerr << "[錯誤] 無法寫入量測結果: " << metricsPath << endl;
+        if (status == 0) status = 1;
+    }
+    return status;
+}
+
+int main(int argc, char* argv[]) {
+    // 有參數時執行單一指令後結束，不清除畫面也不等待輸入
+    if (argc > 1) {
+        #ifdef _WIN32
+            system("chcp 65001 > nul");
+        #endif
+        return runCommandLine(argc, argv);
+    }
+
     #ifdef _WIN32
         system("chcp 65001");
     #endif
@@ -139,7 +600,8 @@ int main() {
         cout << "3. 加密檔案 (Sender)" << endl;
         cout << "4. 解密檔案 (Receiver)" << endl;
         cout << "5. 檔案雜湊驗證 (SHA-256)" << endl;  // <-- 新增選單
-        cout << "6. 離開" << endl;                    // <-- 選項順延
+        cout << "6. RSA 批次解密效能測試" << endl;
+        cout << "7. 離開" << endl;
         cout << "============================================" << endl;
         cout << "請輸入選項: ";
 
@@ -160,6 +622,7 @@ int main() {
             cout << "\n[系統] 生成金鑰中 (Bits=1024)..." << endl;
             try {
                 globalRSAKey = rsa_keygen(1024);
+                globalRSAContext = rsa_context(globalRSAKey);
                 hasKey = true;
                 saveRSAKey(customName);
             } catch (const exception& e) {
@@ -189,7 +652,7 @@ int main() {
         else if (choice == '3') { 
             if (!hasKey) { cout << "\n[警告] 請先執行選項 1 或 2 載入金鑰！" << endl; pause(); continue; }
 
-            string inFile, outFile, keyFile;
+            string inFile, outFile;
             cout << "\n--- 加密模式 ---" << endl;
             
             while (true) {
@@ -204,25 +667,13 @@ int main() {
             getline(cin, outFile);
             if (outFile.empty()) outFile = "after_encrpto.serpent";
 
-            cout << "輸入 Session Key 儲存檔名 (預設 session.key): ";
-            getline(cin, keyFile);
-            if (keyFile.empty()) keyFile = "session.key";
-
-            cout << "[1/3] 生成並保護 Session Key..." << endl;
-            mpz_class sessionKey = random_bits(256);
-            mpz_class encKey = rsa_encrypt(sessionKey, globalRSAKey);
-            
-            ofstream kout(DATA_DIR + keyFile);
-            kout << encKey.get_str();
-            kout.close();
-
-            cout << "[2/3] Serpent 加密..." << endl;
-            Serpent cipher;
-            cipher.setKey(sessionKey);
-            
-            if (cipher.encryptFile(DATA_DIR + inFile, DATA_DIR + outFile)) {
+            // 加密時順便計算原始檔與加密檔的 SHA-256，不必再用選項 5 重讀一次
+            SHA256 plainHash, cipherHash;
+            if (hybridEncrypt(DATA_DIR + inFile, DATA_DIR + outFile, CipherOptions(), &plainHash, &cipherHash)) {
                 cout << "\n[成功] 加密完成！" << endl;
                 cout << "   -> 檔案位於: " << DATA_DIR << outFile << endl;
+                cout << "   -> 原始檔 SHA-256: " << SHA256::toString(plainHash.digest()) << endl;
+                cout << "   -> 加密檔 SHA-256: " << SHA256::toString(cipherHash.digest()) << endl;
             } else {
                 cout << "\n[失敗] 加密錯誤。" << endl;
             }
@@ -243,26 +694,26 @@ int main() {
                 cout << "找不到檔案。" << endl;
             }
 
-            cout << "輸入 Session Key 檔名 (預設 session.key): ";
-            getline(cin, keyFile);
-            if (keyFile.empty()) keyFile = "session.key";
+            // 新版容器檔的標頭內含包裝金鑰；舊版檔案才需要另外的 session.key
+            string legacyKeyPath;
+            if (!Serpent::isContainer(DATA_DIR + encFile)) {
+                cout << "輸入 Session Key 檔名 (預設 session.key): ";
+                getline(cin, keyFile);
+                if (keyFile.empty()) keyFile = "session.key";
+                mpz_class wrappedKey;
+                if (!rsa_load_wrapped_key(DATA_DIR + keyFile, wrappedKey)) { cout << "找不到金鑰檔或格式錯誤！" << endl; pause(); continue; }
+                legacyKeyPath = DATA_DIR + keyFile;
+            }
 
             cout << "輸入解密後檔名 (預設 after_decrypto.txt): ";
             getline(cin, decFile);
             if (decFile.empty()) decFile = "after_decrypto.txt";
 
-            ifstream kin(DATA_DIR + keyFile);
-            if (!kin) { cout << "找不到金鑰檔！" << endl; pause(); continue; }
-            string keyStr; kin >> keyStr;
-            mpz_class sessionKey = rsa_decrypt(mpz_class(keyStr), globalRSAKey);
-
-            cout << "[1/1] Serpent 解密..." << endl;
-            Serpent cipher;
-            cipher.setKey(sessionKey);
-            
-            if (cipher.decryptFile(DATA_DIR + encFile, DATA_DIR + decFile)) {
+            SHA256 plainHash;
+            if (hybridDecrypt(DATA_DIR + encFile, DATA_DIR + decFile, legacyKeyPath, CipherOptions(), &plainHash)) {
                 cout << "\n[成功] 解密完成！" << endl;
                 cout << "   -> 檔案位於: " << DATA_DIR << decFile << endl;
+                cout << "   -> 還原檔 SHA-256: " << SHA256::toString(plainHash.digest()) << endl;
             } else {
                 cout << "\n[失敗] 解密錯誤。" << endl;
             }
@@ -281,7 +732,12 @@ int main() {
             hashFile(hashFileTarget);
             pause();
         }
-        else if (choice == '6') break; // 順延
+        else if (choice == '6') {
+            if (!hasKey) { cout << "\n[警告] 請先執行選項 1 或 2 載入金鑰！" << endl; pause(); continue; }
+            benchmarkRSADecrypt();
+            pause();
+        }
+        else if (choice == '7') break; // 順延
     }
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,78 @@
+#include "HMACSHA256.h"
+#include <cstring>
+#include <iostream>
+
+HMACSHA256::HMACSHA256(const uint8_t * key, size_t keyLength) {
+	uint8_t block[64];
+	memset(block, 0, sizeof(block));
+
+	if (keyLength > 64) {
+		SHA256 sha;
+		sha.update(key, keyLength);
+		std::array<uint8_t, 32> hashed = sha.digest();
+		memcpy(block, hashed.data(), hashed.size());
+	} else {
+		memcpy(block, key, keyLength);
+	}
+
+	uint8_t pad[64];
+	for (int i = 0 ; i < 64 ; i++) pad[i] = block[i] ^ 0x36;
+	m_inner.update(pad, sizeof(pad));
+	for (int i = 0 ; i < 64 ; i++) pad[i] = block[i] ^ 0x5c;
+	m_outer.update(pad, sizeof(pad));
+
+	memset(block, 0, sizeof(block));
+	memset(pad, 0, sizeof(pad));
+}
+
+void HMACSHA256::update(const uint8_t * data, size_t length) {
+	m_inner.update(data, length);
+}
+
+void HMACSHA256::update(const std::string &data) {
+	m_inner.update(data);
+}
+
+std::array<uint8_t, 32> HMACSHA256::digest() {
+	std::array<uint8_t, 32> innerHash = m_inner.digest();
+	m_outer.update(innerHash.data(), innerHash.size());
+	return m_outer.digest();
+}
+
+bool HMACSHA256::equal(const uint8_t * a, const uint8_t * b, size_t length) {
+	uint8_t diff = 0;
+	for (size_t i = 0 ; i < length ; i++) {
+		diff |= a[i] ^ b[i];
+	}
+	return diff == 0;
+}
+
+bool HMACSHA256::runKnownAnswerTest() {
+	struct Vector { const char * name; std::string key; std::string data; const char * mac; };
+	const Vector vectors[] = {
+		{ "RFC 4231 #1", std::string(20, '\x0b'), "Hi There",
+		  "b0344c61d8db38535ca8afceaf0bf12b881dc200c9833da726e9376c2e32cff7" },
+		{ "RFC 4231 #2", "Jefe", "what do ya want for nothing?",
+		  "5bdcc146bf60754e6a042426089575c75a003f089d2739839dec58b964ec3843" },
+		{ "RFC 4231 #3", std::string(20, '\xaa'), std::string(50, '\xdd'),
+		  "773ea91e36800e46854db8ebd09181a72959098b3ef8c122d9635514ced565fe" },
+		{ "RFC 4231 #6", std::string(131, '\xaa'), "Test Using Larger Than Block-Size Key - Hash Key First",
+		  "60e431591ee0b67f0d8a26aacbf5b77f8e0bc6213728c5140546040f0ee37f54" },
+		{ "RFC 4231 #7", std::string(131, '\xaa'),
+		  "This is a test using a larger than block-size key and a larger than block-size data. "
+		  "The key needs to be hashed before being used by the HMAC algorithm.",
+		  "9b09ffa71b942fcb27635fbcd5b0e944bfdc63644f0713938a7f51535c3a35e2" },
+	};
+
+	bool ok = true;
+	for (const Vector & v : vectors) {
+		HMACSHA256 mac(reinterpret_cast<const uint8_t*>(v.key.data()), v.key.size());
+		mac.update(v.data);
+		if (SHA256::toString(mac.digest()) != v.mac) {
+			std::cerr << "[FAIL] HMAC-SHA256 " << v.name << " 與測試向量不符！\n";
+			ok = false;
+		}
+	}
+	if (ok) std::cout << "[PASS] HMAC-SHA256 測試向量 (RFC 4231) 一致。\n";
+	return ok;
+}
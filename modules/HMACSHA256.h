@@ -0,0 +1,35 @@
+#ifndef HMAC_SHA256_H
+#define HMAC_SHA256_H
+
+#include <string>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include "SHA256.h"
+
+// HMAC-SHA256 (RFC 2104)：H((K ^ opad) || H((K ^ ipad) || message))
+// 內外兩層直接使用 SHA256 類別，可以像 SHA256 一樣分段 update，
+// 適合邊加密邊計算 (encrypt-then-MAC) 的串流處理。
+class HMACSHA256 {
+
+public:
+	// 金鑰超過 64 bytes 時先做一次 SHA-256 (RFC 2104 的規定)
+	HMACSHA256(const uint8_t * key, size_t keyLength);
+
+	void update(const uint8_t * data, size_t length);
+	void update(const std::string &data);
+	// 回傳 32-byte 驗證碼，之後物件不可再使用
+	std::array<uint8_t, 32> digest();
+
+	// 固定時間比較，避免從比對時間推測驗證碼
+	static bool equal(const uint8_t * a, const uint8_t * b, size_t length);
+
+	// RFC 4231 測試向量 (含超過區塊大小的金鑰)；全部一致時回傳 true，失敗項目印到 std::cerr
+	static bool runKnownAnswerTest();
+
+private:
+	SHA256  m_inner;
+	SHA256  m_outer;
+};
+
+#endif
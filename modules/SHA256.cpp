@@ -1,11 +1,22 @@
 #include "SHA256.h"
+#include "metrics.hpp"
 #include <cstring>
 #include <sstream>
 #include <iomanip>
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SHA256_HAVE_SHANI 1
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
 
 constexpr std::array<uint32_t, 64> SHA256::K;
 
-SHA256::SHA256(): m_blocklen(0), m_bitlen(0) {
+SHA256::SHA256(): m_blocklen(0), m_bitlen(0), m_backend(detectBackend()) {
 	m_state[0] = 0x6a09e667;
 	m_state[1] = 0xbb67ae85;
 	m_state[2] = 0x3c6ef372;
@@ -17,16 +28,37 @@ SHA256::SHA256(): m_blocklen(0), m_bitlen(0) {
 }
 
 void SHA256::update(const uint8_t * data, size_t length) {
-	for (size_t i = 0 ; i < length ; i++) {
-		m_data[m_blocklen++] = data[i];
-		if (m_blocklen == 64) {
-			transform();
-
-			// End of the block
-			m_bitlen += 512;
-			m_blocklen = 0;
-		}
+	StageTimer timer(Metrics::Stage::Sha256Update, length);
+
+	// 1. 先補滿上次留下的未滿區塊
+	if (m_blocklen > 0) {
+		size_t take = std::min<size_t>(64 - m_blocklen, length);
+		memcpy(m_data + m_blocklen, data, take);
+		m_blocklen += take;
+		data += take;
+		length -= take;
+
+		if (m_blocklen < 64) return; // 輸入不夠補滿一個區塊
+
+		transform();
+
+		// End of the block
+		m_bitlen += 512;
+		m_blocklen = 0;
+	}
+
+	// 2. 完整的 64-byte 區塊直接從呼叫端的 buffer 運算，不複製
+	size_t nblocks = length / 64;
+	if (nblocks > 0) {
+		transformBlocks(data, nblocks);
+		m_bitlen += 512 * static_cast<uint64_t>(nblocks);
+		data += 64 * nblocks;
+		length -= 64 * nblocks;
 	}
+
+	// 3. 剩下不足一個區塊的尾端留到下次
+	memcpy(m_data, data, length);
+	m_blocklen = length;
 }
 
 void SHA256::update(const std::string &data) {
@@ -63,46 +95,149 @@ uint32_t SHA256::sig1(uint32_t x) {
 }
 
 void SHA256::transform() {
+	transformBlocks(m_data, 1);
+}
+
+void SHA256::transformBlocks(const uint8_t * data, size_t nblocks) {
+	if (m_backend == Backend::SHANI) {
+		transformSHANI(m_state, data, nblocks);
+	} else {
+		transformScalar(m_state, data, nblocks);
+	}
+}
+
+void SHA256::transformScalar(uint32_t m_state[8], const uint8_t * data, size_t nblocks) {
 	uint32_t maj, xorA, ch, xorE, sum, newA, newE, m[64];
 	uint32_t state[8];
 
-	for (uint8_t i = 0, j = 0; i < 16; i++, j += 4) { // Split data in 32 bit blocks for the 16 first words
-		m[i] = (m_data[j] << 24) | (m_data[j + 1] << 16) | (m_data[j + 2] << 8) | (m_data[j + 3]);
-	}
+	for (size_t b = 0 ; b < nblocks ; b++, data += 64) {
+		const uint8_t * m_data = data;
 
-	for (uint8_t k = 16 ; k < 64; k++) { // Remaining 48 blocks
-		m[k] = SHA256::sig1(m[k - 2]) + m[k - 7] + SHA256::sig0(m[k - 15]) + m[k - 16];
-	}
+		for (uint8_t i = 0, j = 0; i < 16; i++, j += 4) { // Split data in 32 bit blocks for the 16 first words
+			m[i] = (m_data[j] << 24) | (m_data[j + 1] << 16) | (m_data[j + 2] << 8) | (m_data[j + 3]);
+		}
 
-	for(uint8_t i = 0 ; i < 8 ; i++) {
-		state[i] = m_state[i];
-	}
+		for (uint8_t k = 16 ; k < 64; k++) { // Remaining 48 blocks
+			m[k] = SHA256::sig1(m[k - 2]) + m[k - 7] + SHA256::sig0(m[k - 15]) + m[k - 16];
+		}
+
+		for(uint8_t i = 0 ; i < 8 ; i++) {
+			state[i] = m_state[i];
+		}
+
+		for (uint8_t i = 0; i < 64; i++) {
+			maj   = SHA256::majority(state[0], state[1], state[2]);
+			xorA  = SHA256::rotr(state[0], 2) ^ SHA256::rotr(state[0], 13) ^ SHA256::rotr(state[0], 22);
 
-	for (uint8_t i = 0; i < 64; i++) {
-		maj   = SHA256::majority(state[0], state[1], state[2]);
-		xorA  = SHA256::rotr(state[0], 2) ^ SHA256::rotr(state[0], 13) ^ SHA256::rotr(state[0], 22);
+			ch = choose(state[4], state[5], state[6]);
 
-		ch = choose(state[4], state[5], state[6]);
+			xorE  = SHA256::rotr(state[4], 6) ^ SHA256::rotr(state[4], 11) ^ SHA256::rotr(state[4], 25);
 
-		xorE  = SHA256::rotr(state[4], 6) ^ SHA256::rotr(state[4], 11) ^ SHA256::rotr(state[4], 25);
+			sum  = m[i] + K[i] + state[7] + ch + xorE;
+			newA = xorA + maj + sum;
+			newE = state[3] + sum;
 
-		sum  = m[i] + K[i] + state[7] + ch + xorE;
-		newA = xorA + maj + sum;
-		newE = state[3] + sum;
+			state[7] = state[6];
+			state[6] = state[5];
+			state[5] = state[4];
+			state[4] = newE;
+			state[3] = state[2];
+			state[2] = state[1];
+			state[1] = state[0];
+			state[0] = newA;
+		}
 
-		state[7] = state[6];
-		state[6] = state[5];
-		state[5] = state[4];
-		state[4] = newE;
-		state[3] = state[2];
-		state[2] = state[1];
-		state[1] = state[0];
-		state[0] = newA;
+		for(uint8_t i = 0 ; i < 8 ; i++) {
+			m_state[i] += state[i];
+		}
 	}
+}
+
+#ifdef SHA256_HAVE_SHANI
+// SHA-NI 版本：每次 sha256rnds2 做 2 輪，state 以 ABEF / CDGH 兩個暫存器保存。
+// msg1/msg2 負責訊息擴展，16 組 (每組 4 輪) 中 MSG[0..3] 輪流使用。
+__attribute__((target("sha,sse4.1,ssse3")))
+void SHA256::transformSHANI(uint32_t state[8], const uint8_t * data, size_t nblocks) {
+	const __m128i MASK = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL); // big endian 轉換
+
+	// 載入 state 並重排成 ABEF / CDGH
+	__m128i tmp    = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[0]));
+	__m128i state1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[4]));
+	tmp    = _mm_shuffle_epi32(tmp, 0xB1);          // CDAB
+	state1 = _mm_shuffle_epi32(state1, 0x1B);       // EFGH
+	__m128i state0 = _mm_alignr_epi8(tmp, state1, 8); // ABEF
+	state1 = _mm_blend_epi16(state1, tmp, 0xF0);    // CDGH
+
+	for (size_t b = 0 ; b < nblocks ; b++, data += 64) {
+		const __m128i abefSave = state0;
+		const __m128i cdghSave = state1;
+		__m128i msgs[4];
+
+		// 完全展開後 msgs[] 的索引都是常數，才能全部放在暫存器
+		#pragma GCC unroll 16
+		for (int g = 0 ; g < 16 ; g++) {
+			if (g < 4) {
+				msgs[g] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16 * g)), MASK);
+			}
+			__m128i msg = _mm_add_epi32(msgs[g % 4], _mm_loadu_si128(reinterpret_cast<const __m128i*>(&K[4 * g])));
+			state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+
+			// 產生下一組 W (msg2 需要前一組 W 的高位)
+			if (g >= 3 && g <= 14) {
+				__m128i t = _mm_alignr_epi8(msgs[g % 4], msgs[(g + 3) % 4], 4);
+				msgs[(g + 1) % 4] = _mm_add_epi32(msgs[(g + 1) % 4], t);
+				msgs[(g + 1) % 4] = _mm_sha256msg2_epu32(msgs[(g + 1) % 4], msgs[g % 4]);
+			}
+
+			msg = _mm_shuffle_epi32(msg, 0x0E);
+			state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+
+			if (g >= 1 && g <= 12) {
+				msgs[(g + 3) % 4] = _mm_sha256msg1_epu32(msgs[(g + 3) % 4], msgs[g % 4]);
+			}
+		}
 
-	for(uint8_t i = 0 ; i < 8 ; i++) {
-		m_state[i] += state[i];
+		state0 = _mm_add_epi32(state0, abefSave);
+		state1 = _mm_add_epi32(state1, cdghSave);
 	}
+
+	// 還原成 ABCD / EFGH
+	tmp    = _mm_shuffle_epi32(state0, 0x1B);       // FEBA
+	state1 = _mm_shuffle_epi32(state1, 0xB1);       // DCHG
+	state0 = _mm_blend_epi16(tmp, state1, 0xF0);    // DCBA (即 state[0..3] = A, B, C, D)
+	state1 = _mm_alignr_epi8(state1, tmp, 8);       // HGFE (即 state[4..7] = E, F, G, H)
+
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(&state[0]), state0);
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(&state[4]), state1);
+}
+#else
+void SHA256::transformSHANI(uint32_t state[8], const uint8_t * data, size_t nblocks) {
+	transformScalar(state, data, nblocks); // 非 x86 平台不會選到 SHANI，這裡只是保險
+}
+#endif
+
+SHA256::Backend SHA256::detectBackend() {
+	static const Backend detected = []() {
+#ifdef SHA256_HAVE_SHANI
+		unsigned int eax, ebx, ecx, edx;
+		if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return Backend::Scalar;
+		bool ssse3  = (ecx & (1u << 9)) != 0;
+		bool sse41  = (ecx & (1u << 19)) != 0;
+		if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) return Backend::Scalar;
+		bool sha    = (ebx & (1u << 29)) != 0;
+		if (ssse3 && sse41 && sha) return Backend::SHANI;
+#endif
+		return Backend::Scalar;
+	}();
+	return detected;
+}
+
+const char* SHA256::backendName(Backend b) {
+	return b == Backend::SHANI ? "sha-ni" : "scalar";
+}
+
+void SHA256::setBackend(Backend b) {
+	m_backend = (b == Backend::SHANI && detectBackend() != Backend::SHANI) ? Backend::Scalar : b;
 }
 
 void SHA256::pad() {
@@ -153,3 +288,68 @@ std::string SHA256::toString(const std::array<uint8_t, 32> & digest) {
 
 	return s.str();
 }
+
+// FIPS 180-2 附錄 B 與 NIST 範例 (896-bit 訊息) 的測試向量
+bool SHA256::runKnownAnswerTest() {
+	struct Vector { const char * name; std::string message; size_t repeat; const char * digest; };
+	const Vector vectors[] = {
+		{ "空字串", "", 1, "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855" },
+		{ "\"abc\"", "abc", 1, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad" },
+		{ "448-bit", "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", 1,
+		  "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1" },
+		{ "896-bit", "abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmnhijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu", 1,
+		  "cf5b16a778af8380036ce59e7b0492370b249b11e8f07a51afac45037afee9d1" },
+		{ "一百萬個 'a'", std::string(1000, 'a'), 1000, "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0" },
+	};
+
+	bool ok = true;
+	for (int b = static_cast<int>(Backend::Scalar); b <= static_cast<int>(detectBackend()); b++) {
+		for (const Vector & v : vectors) {
+			SHA256 sha;
+			sha.setBackend(static_cast<Backend>(b));
+			for (size_t i = 0; i < v.repeat; i++) sha.update(v.message);
+			if (toString(sha.digest()) != v.digest) {
+				std::cerr << "[FAIL] SHA-256 " << v.name << " (" << backendName(static_cast<Backend>(b)) << ") 與測試向量不符！\n";
+				ok = false;
+			}
+		}
+	}
+	if (ok) std::cout << "[PASS] SHA-256 測試向量 (FIPS 180-2 / NIST) 全部 backend 一致。\n";
+	return ok;
+}
+
+bool SHA256::runDifferentialTest(uint64_t bytes, uint64_t seed) {
+	if (detectBackend() == Backend::Scalar) {
+		std::cout << "[PASS] 只有 scalar backend，不需要差分比對。\n";
+		return true;
+	}
+
+	std::mt19937_64 rng(seed);
+	std::vector<uint8_t> msg;
+	uint64_t done = 0;
+	for (uint64_t iter = 0; done < bytes; iter++) {
+		// 長度涵蓋 padding 的各種邊界 (55/56/64 附近)，偶爾出現較長的訊息
+		size_t len = (rng() % 8 == 0) ? rng() % 65536 : rng() % 300;
+		msg.resize(len);
+		for (uint8_t & x : msg) x = static_cast<uint8_t>(rng());
+
+		SHA256 ref, fast;
+		ref.setBackend(Backend::Scalar);
+		fast.setBackend(detectBackend());
+		ref.update(msg.data(), msg.size());
+		// 加速版本以隨機切段 update，同時檢查跨區塊的暫存邏輯
+		for (size_t pos = 0; pos < len; ) {
+			size_t take = std::min<size_t>(len - pos, 1 + rng() % 200);
+			fast.update(msg.data() + pos, take);
+			pos += take;
+		}
+		if (ref.digest() != fast.digest()) {
+			std::cerr << "[FAIL] SHA-256 " << backendName(detectBackend()) << " 與 scalar 不一致 (seed = " << seed
+			          << ", 第 " << iter << " 輪, " << len << " bytes)\n";
+			return false;
+		}
+		done += len;
+	}
+	std::cout << "[PASS] SHA-256：" << done << " bytes 隨機訊息，" << backendName(detectBackend()) << " 與 scalar 一致。\n";
+	return true;
+}
@@ -8,6 +8,9 @@
 class SHA256 {
 
 public:
+	// 壓縮函式的實作方式：Scalar 為可攜版本，SHANI 使用 x86 SHA 指令 (sha256rnds2/msg1/msg2)
+	enum class Backend { Scalar, SHANI };
+
 	SHA256();
 	void update(const uint8_t * data, size_t length);
 	void update(const std::string &data);
@@ -15,11 +18,25 @@ public:
 
 	static std::string toString(const std::array<uint8_t, 32> & digest);
 
+	// 以 CPUID 偵測是否支援 SHA 指令 (預設使用可用的最快版本)
+	static Backend detectBackend();
+	static const char* backendName(Backend b);
+	// 強制使用某個實作 (測試比對用)，CPU 不支援時退回 Scalar
+	void setBackend(Backend b);
+	Backend getBackend() const { return m_backend; }
+
+	// 自我診斷 (全部通過時回傳 true；失敗項目印到 std::cerr)
+	// runKnownAnswerTest : FIPS 180-2 / NIST 測試向量，每個 backend 都比對
+	// runDifferentialTest: 隨機長度與隨機切段的 update，比對 SHA-NI 與 scalar，至少處理 bytes 個 bytes
+	static bool runKnownAnswerTest();
+	static bool runDifferentialTest(uint64_t bytes, uint64_t seed);
+
 private:
 	uint8_t  m_data[64];
 	uint32_t m_blocklen;
 	uint64_t m_bitlen;
 	uint32_t m_state[8]; //A, B, C, D, E, F, G, H
+	Backend  m_backend;
 
 	static constexpr std::array<uint32_t, 64> K = {
 		0x428a2f98,0x71374491,0xb5c0fbcf,0xe9b5dba5,
@@ -46,6 +63,10 @@ private:
 	static uint32_t sig0(uint32_t x);
 	static uint32_t sig1(uint32_t x);
 	void transform();
+	void transformBlocks(const uint8_t * data, size_t nblocks);
+	// 對連續 nblocks 個 64-byte 區塊更新 state
+	static void transformScalar(uint32_t state[8], const uint8_t * data, size_t nblocks);
+	static void transformSHANI(uint32_t state[8], const uint8_t * data, size_t nblocks);
 	void pad();
 	void revert(std::array<uint8_t, 32> & hash);
 };
@@ -0,0 +1,363 @@
+#include "SHA256Multi.h"
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+#include <iostream>
+#include <random>
+#include "SHA256.h"
+
+#if defined(__GNUC__)
+#define SHA256M_INLINE inline __attribute__((always_inline))
+#else
+#define SHA256M_INLINE inline
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SHA256M_HAVE_SIMD 1
+typedef uint32_t u32x4  __attribute__((vector_size(16)));
+typedef uint32_t u32x8  __attribute__((vector_size(32)));
+typedef uint32_t u32x16 __attribute__((vector_size(64)));
+#endif
+
+static const uint32_t K256[64] = {
+	0x428a2f98,0x71374491,0xb5c0fbcf,0xe9b5dba5,
+	0x3956c25b,0x59f111f1,0x923f82a4,0xab1c5ed5,
+	0xd807aa98,0x12835b01,0x243185be,0x550c7dc3,
+	0x72be5d74,0x80deb1fe,0x9bdc06a7,0xc19bf174,
+	0xe49b69c1,0xefbe4786,0x0fc19dc6,0x240ca1cc,
+	0x2de92c6f,0x4a7484aa,0x5cb0a9dc,0x76f988da,
+	0x983e5152,0xa831c66d,0xb00327c8,0xbf597fc7,
+	0xc6e00bf3,0xd5a79147,0x06ca6351,0x14292967,
+	0x27b70a85,0x2e1b2138,0x4d2c6dfc,0x53380d13,
+	0x650a7354,0x766a0abb,0x81c2c92e,0x92722c85,
+	0xa2bfe8a1,0xa81a664b,0xc24b8b70,0xc76c51a3,
+	0xd192e819,0xd6990624,0xf40e3585,0x106aa070,
+	0x19a4c116,0x1e376c08,0x2748774c,0x34b0bcb5,
+	0x391c0cb3,0x4ed8aa4a,0x5b9cca4f,0x682e6ff3,
+	0x748f82ee,0x78a5636f,0x84c87814,0x8cc70208,
+	0x90befffa,0xa4506ceb,0xbef9a3f7,0xc67178f2
+};
+
+static const uint32_t H0[8] = {
+	0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+	0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+// =========================================================
+//  多 lane 壓縮函式
+// =========================================================
+// V 可以是 uint32_t (1 lane) 或 GCC vector extension (4 / 8 / 16 lanes)，
+// 運算只有加法、位元運算與位移，同一份 template 就能套用在所有寬度上。
+// 第 k 個 lane 的 state 為 state[k][0..7]，資料從 data[k] 開始連續 nblocks 個 64-byte 區塊。
+
+static SHA256M_INLINE uint32_t loadBE32(const uint8_t * p) {
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static SHA256M_INLINE void setLane(uint32_t & v, int, uint32_t x) { v = x; }
+static SHA256M_INLINE uint32_t getLane(const uint32_t & v, int) { return v; }
+
+template <typename V>
+static SHA256M_INLINE void setLane(V & v, int k, uint32_t x) { v[k] = x; }
+template <typename V>
+static SHA256M_INLINE uint32_t getLane(const V & v, int k) { return v[k]; }
+
+#define SHA256M_ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+template <typename V, int LANES>
+static SHA256M_INLINE void compressLanes(uint32_t * const state[], const uint8_t * const data[], size_t nblocks) {
+	V s[8];
+	for (int i = 0 ; i < 8 ; i++) {
+		for (int k = 0 ; k < LANES ; k++) setLane(s[i], k, state[k][i]);
+	}
+
+	for (size_t b = 0 ; b < nblocks ; b++) {
+		V w[16];
+		for (int i = 0 ; i < 16 ; i++) {
+			for (int k = 0 ; k < LANES ; k++) setLane(w[i], k, loadBE32(data[k] + 64 * b + 4 * i));
+		}
+
+		V a = s[0], bb = s[1], c = s[2], d = s[3];
+		V e = s[4], f = s[5], g = s[6], h = s[7];
+
+		// 訊息擴展只保留最近 16 個 word (環狀)，展開後索引都是常數
+		#pragma GCC unroll 64
+		for (int t = 0 ; t < 64 ; t++) {
+			if (t >= 16) {
+				V w2  = w[(t - 2) & 15];
+				V w15 = w[(t - 15) & 15];
+				V sig1 = SHA256M_ROTR(w2, 17) ^ SHA256M_ROTR(w2, 19) ^ (w2 >> 10);
+				V sig0 = SHA256M_ROTR(w15, 7) ^ SHA256M_ROTR(w15, 18) ^ (w15 >> 3);
+				w[t & 15] += sig1 + w[(t - 7) & 15] + sig0;
+			}
+
+			V sum1 = SHA256M_ROTR(e, 6) ^ SHA256M_ROTR(e, 11) ^ SHA256M_ROTR(e, 25);
+			V ch   = (e & f) ^ (~e & g);
+			V t1   = h + sum1 + ch + K256[t] + w[t & 15];
+			V sum0 = SHA256M_ROTR(a, 2) ^ SHA256M_ROTR(a, 13) ^ SHA256M_ROTR(a, 22);
+			V maj  = (a & (bb | c)) | (bb & c);
+
+			h = g; g = f; f = e; e = d + t1;
+			d = c; c = bb; bb = a; a = t1 + sum0 + maj;
+		}
+
+		s[0] += a; s[1] += bb; s[2] += c; s[3] += d;
+		s[4] += e; s[5] += f; s[6] += g; s[7] += h;
+	}
+
+	for (int i = 0 ; i < 8 ; i++) {
+		for (int k = 0 ; k < LANES ; k++) state[k][i] = getLane(s[i], k);
+	}
+}
+
+static void compressScalar(uint32_t * const state[], const uint8_t * const data[], size_t nblocks) {
+	compressLanes<uint32_t, 1>(state, data, nblocks);
+}
+
+#ifdef SHA256M_HAVE_SIMD
+__attribute__((target("sse2")))
+static void compressSSE2(uint32_t * const state[], const uint8_t * const data[], size_t nblocks) {
+	compressLanes<u32x4, 4>(state, data, nblocks);
+}
+
+__attribute__((target("avx2")))
+static void compressAVX2(uint32_t * const state[], const uint8_t * const data[], size_t nblocks) {
+	compressLanes<u32x8, 8>(state, data, nblocks);
+}
+
+__attribute__((target("avx512f")))
+static void compressAVX512(uint32_t * const state[], const uint8_t * const data[], size_t nblocks) {
+	compressLanes<u32x16, 16>(state, data, nblocks);
+}
+#endif
+
+// state / data 都必須有 backendWidth(backend) 個元素
+static void compressBackend(SHA256Multi::Backend backend, uint32_t * const state[], const uint8_t * const data[], size_t nblocks) {
+	switch (backend) {
+#ifdef SHA256M_HAVE_SIMD
+		case SHA256Multi::Backend::SSE2:   compressSSE2(state, data, nblocks); return;
+		case SHA256Multi::Backend::AVX2:   compressAVX2(state, data, nblocks); return;
+		case SHA256Multi::Backend::AVX512: compressAVX512(state, data, nblocks); return;
+#endif
+		default: compressScalar(state, data, nblocks); return;
+	}
+}
+
+// =========================================================
+//  SHA256Multi
+// =========================================================
+SHA256Multi::SHA256Multi(size_t lanes): m_lanes(lanes), m_backend(detectBackend()) {
+	if (lanes == 0) throw std::invalid_argument("SHA256Multi needs at least one lane.");
+	reset();
+}
+
+void SHA256Multi::resetLane(Lane & lane) {
+	memcpy(lane.state, H0, sizeof(H0));
+	lane.pending.clear();
+	lane.consumed = 0;
+	lane.length = 0;
+}
+
+void SHA256Multi::reset() {
+	for (Lane & lane : m_lanes) resetLane(lane);
+}
+
+void SHA256Multi::update(size_t lane, const uint8_t * data, size_t length) {
+	if (lane >= m_lanes.size()) throw std::out_of_range("SHA256Multi lane index out of range.");
+
+	Lane & l = m_lanes[lane];
+	l.pending.insert(l.pending.end(), data, data + length);
+	l.length += length;
+
+	compressGroup(lane / backendWidth(m_backend), false);
+
+	// 同組其他 lane 沒跟上時，避免單一 lane 無限制地暫存
+	if (l.pending.size() - l.consumed > MAX_PENDING) {
+		size_t nblocks = (l.pending.size() - l.consumed) / 64;
+		uint32_t * state[1] = { l.state };
+		const uint8_t * ptr[1] = { l.pending.data() + l.consumed };
+		compressScalar(state, ptr, nblocks);
+		l.consumed += 64 * nblocks;
+		compact(l);
+	}
+}
+
+void SHA256Multi::update(size_t lane, const std::string &data) {
+	update(lane, reinterpret_cast<const uint8_t*> (data.c_str()), data.size());
+}
+
+void SHA256Multi::compact(Lane & lane) {
+	if (lane.consumed == 0) return;
+	lane.pending.erase(lane.pending.begin(), lane.pending.begin() + lane.consumed);
+	lane.consumed = 0;
+}
+
+void SHA256Multi::compressGroup(size_t group, bool drain) {
+	const size_t width = backendWidth(m_backend);
+	const size_t first = group * width;
+	const size_t count = std::min(width, m_lanes.size() - first);
+
+	uint32_t   scratch[16][8];   // 沒有資料的 lane 寫到這裡，結果丟棄
+	uint32_t * state[16];
+	const uint8_t * data[16];
+
+	while (true) {
+		// 取組內所有「還有完整區塊」的 lane 的最小區塊數
+		size_t nblocks = 0;
+		size_t active = 0;
+		const uint8_t * filler = nullptr;
+		for (size_t k = 0 ; k < count ; k++) {
+			Lane & l = m_lanes[first + k];
+			size_t avail = (l.pending.size() - l.consumed) / 64;
+			if (avail == 0) continue;
+			nblocks = (active == 0) ? avail : std::min(nblocks, avail);
+			if (filler == nullptr) filler = l.pending.data() + l.consumed;
+			active++;
+		}
+		if (active == 0) break;
+		if (!drain && active < count) break;
+
+		// 沒有資料的 lane 借用任一個有效 lane 的資料跑，保證讀取的記憶體合法
+		for (size_t k = 0 ; k < width ; k++) {
+			Lane * l = (k < count) ? &m_lanes[first + k] : nullptr;
+			if (l != nullptr && l->pending.size() - l->consumed >= 64) {
+				state[k] = l->state;
+				data[k]  = l->pending.data() + l->consumed;
+			} else {
+				state[k] = scratch[k];
+				data[k]  = filler;
+			}
+		}
+
+		compressBackend(m_backend, state, data, nblocks);
+
+		for (size_t k = 0 ; k < count ; k++) {
+			Lane & l = m_lanes[first + k];
+			if (l.pending.size() - l.consumed >= 64) l.consumed += 64 * nblocks;
+		}
+	}
+
+	for (size_t k = 0 ; k < count ; k++) compact(m_lanes[first + k]);
+}
+
+std::vector<std::array<uint8_t, 32>> SHA256Multi::digestAll() {
+	// 補上 padding：0x80、補零到 56 mod 64、最後 8 bytes 為 big-endian 位元長度
+	for (Lane & l : m_lanes) {
+		uint64_t bitlen = l.length * 8;
+		l.pending.push_back(0x80);
+		while ((l.pending.size() - l.consumed) % 64 != 56) l.pending.push_back(0x00);
+		for (int i = 7 ; i >= 0 ; i--) l.pending.push_back(static_cast<uint8_t>(bitlen >> (8 * i)));
+	}
+
+	const size_t width = backendWidth(m_backend);
+	for (size_t group = 0 ; group * width < m_lanes.size() ; group++) {
+		compressGroup(group, true);
+	}
+
+	std::vector<std::array<uint8_t, 32>> hashes(m_lanes.size());
+	for (size_t k = 0 ; k < m_lanes.size() ; k++) {
+		for (int i = 0 ; i < 8 ; i++) {
+			uint32_t v = m_lanes[k].state[i];
+			hashes[k][4 * i]     = static_cast<uint8_t>(v >> 24);
+			hashes[k][4 * i + 1] = static_cast<uint8_t>(v >> 16);
+			hashes[k][4 * i + 2] = static_cast<uint8_t>(v >> 8);
+			hashes[k][4 * i + 3] = static_cast<uint8_t>(v);
+		}
+	}
+
+	reset();
+	return hashes;
+}
+
+SHA256Multi::Backend SHA256Multi::detectBackend() {
+	static const Backend detected = []() {
+#ifdef SHA256M_HAVE_SIMD
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx512f")) return Backend::AVX512;
+		if (__builtin_cpu_supports("avx2"))    return Backend::AVX2;
+		if (__builtin_cpu_supports("sse2"))    return Backend::SSE2;
+#endif
+		return Backend::Scalar;
+	}();
+	return detected;
+}
+
+const char* SHA256Multi::backendName(Backend b) {
+	switch (b) {
+		case Backend::Scalar: return "scalar";
+		case Backend::SSE2:   return "sse2";
+		case Backend::AVX2:   return "avx2";
+		case Backend::AVX512: return "avx512";
+	}
+	return "unknown";
+}
+
+bool SHA256Multi::fasterThanSingle() {
+	return SHA256::detectBackend() == SHA256::Backend::Scalar || detectBackend() == Backend::AVX512;
+}
+
+size_t SHA256Multi::backendWidth(Backend b) {
+	switch (b) {
+		case Backend::Scalar: return 1;
+		case Backend::SSE2:   return 4;
+		case Backend::AVX2:   return 8;
+		case Backend::AVX512: return 16;
+	}
+	return 1;
+}
+
+// 每個 lane 的 state 與 pending 各自獨立，中途切換只會改變之後的分組方式
+void SHA256Multi::setBackend(Backend b) {
+	Backend best = detectBackend();
+	m_backend = (b > best) ? best : b;
+}
+
+bool SHA256Multi::runDifferentialTest(uint64_t messages, uint64_t seed) {
+	std::mt19937_64 rng(seed);
+	const Backend best = detectBackend();
+
+	for (int b = static_cast<int>(Backend::Scalar) ; b <= static_cast<int>(best) ; b++) {
+		const Backend backend = static_cast<Backend>(b);
+		uint64_t done = 0;
+		for (uint64_t iter = 0 ; done < messages ; iter++) {
+			// lane 數不一定是向量寬度的倍數，長度差異大時會走到 MAX_PENDING 的單獨壓縮
+			size_t lanes = 1 + rng() % 37;
+			std::vector<std::vector<uint8_t>> msgs(lanes);
+			for (std::vector<uint8_t> & m : msgs) {
+				size_t len = (rng() % 16 == 0) ? rng() % (3 * MAX_PENDING) : rng() % 300;
+				m.resize(len);
+				for (uint8_t & x : m) x = static_cast<uint8_t>(rng());
+			}
+
+			// 各 lane 以隨機大小的片段輪流 update
+			SHA256Multi multi(lanes);
+			multi.setBackend(backend);
+			std::vector<size_t> pos(lanes, 0);
+			size_t remaining = 0;
+			for (const std::vector<uint8_t> & m : msgs) remaining += m.empty() ? 0 : 1;
+			while (remaining > 0) {
+				size_t k = rng() % lanes;
+				if (pos[k] == msgs[k].size()) continue;
+				size_t take = std::min<size_t>(msgs[k].size() - pos[k], 1 + rng() % 4096);
+				multi.update(k, msgs[k].data() + pos[k], take);
+				pos[k] += take;
+				if (pos[k] == msgs[k].size()) remaining--;
+			}
+			std::vector<std::array<uint8_t, 32>> got = multi.digestAll();
+
+			for (size_t k = 0 ; k < lanes ; k++) {
+				SHA256 ref;
+				ref.setBackend(SHA256::Backend::Scalar);
+				ref.update(msgs[k].data(), msgs[k].size());
+				if (ref.digest() != got[k]) {
+					std::cerr << "[FAIL] SHA256Multi " << backendName(backend) << " 與 SHA256 不一致 (seed = " << seed
+					          << ", 第 " << iter << " 輪, lane " << k << ", " << msgs[k].size() << " bytes)\n";
+					return false;
+				}
+			}
+			done += lanes;
+		}
+		std::cout << "[PASS] SHA256Multi " << backendName(backend) << "：" << done << " 個隨機訊息與 SHA256 一致。\n";
+	}
+	return true;
+}
@@ -0,0 +1,70 @@
+#ifndef SHA256_MULTI_H
+#define SHA256_MULTI_H
+
+#include <string>
+#include <array>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// 多路 (multi-buffer) SHA-256：同時計算多個彼此獨立的訊息。
+// 單一訊息的壓縮函式是前後相依的，無法向量化；但不同訊息之間沒有相依性，
+// 因此把每個訊息放在 SIMD 暫存器的一個 lane，一次壓縮 4 / 8 / 16 個區塊 (SSE2 / AVX2 / AVX-512)。
+// lane 依 backend 寬度分組，同一組的 lane 都累積到完整區塊時才一起壓縮；
+// digestAll() 補上各自的 padding，長度不同的 lane 在尾端以遮罩方式處理。
+// 適合大量小檔案，在沒有 SHA-NI 的 CPU 上比逐一呼叫 SHA256 快。
+class SHA256Multi {
+
+public:
+	enum class Backend { Scalar, SSE2, AVX2, AVX512 };
+
+	// lanes 為同時計算的訊息數量，不必是向量寬度的倍數
+	explicit SHA256Multi(size_t lanes);
+
+	void update(size_t lane, const uint8_t * data, size_t length);
+	void update(size_t lane, const std::string &data);
+	// 回傳每個 lane 的雜湊值 (順序同 lane 編號)，並把所有 lane 重設以便重複使用
+	std::vector<std::array<uint8_t, 32>> digestAll();
+	void reset();
+
+	size_t lanes() const { return m_lanes.size(); }
+
+	// 同組其他 lane 遲遲沒有資料時，單一 lane 最多暫存這麼多，超過就自己先以 scalar 壓縮；
+	// 訊息不超過這個長度時，一次 update 整個訊息 (各 lane 依序餵入) 也能全部以 SIMD 壓縮
+	static constexpr size_t MAX_PENDING = 64 * 1024;
+
+	// 大量小訊息時是否比逐一呼叫 SHA256 快 (bench-suite 的 sha256_multi 可重現)：
+	// 沒有 SHA-NI 時 SIMD 多路一定較快；有 SHA-NI 時只有 AVX-512 (16 lanes) 還能勝過
+	static bool fasterThanSingle();
+
+	// 依 CPUID 選擇最寬的向量指令集
+	static Backend detectBackend();
+	static const char* backendName(Backend b);
+	static size_t backendWidth(Backend b);
+	// 強制使用某個實作 (測試比對用)，CPU 不支援時降到 detectBackend() 的結果
+	void setBackend(Backend b);
+	Backend getBackend() const { return m_backend; }
+
+	// 差分測試：隨機 lane 數、隨機長度並交錯 update，比對每個 backend 與逐一使用 SHA256 (scalar) 的結果，
+	// 至少處理 messages 個訊息；全部一致時回傳 true，失敗項目印到 std::cerr
+	static bool runDifferentialTest(uint64_t messages, uint64_t seed);
+
+private:
+	struct Lane {
+		uint32_t state[8];
+		std::vector<uint8_t> pending; // 還沒壓縮的資料
+		size_t   consumed;            // pending 前端已壓縮的 bytes
+		uint64_t length;              // 訊息總長度 (bytes)
+	};
+
+	std::vector<Lane> m_lanes;
+	Backend m_backend;
+
+	void resetLane(Lane & lane);
+	// drain = false：只在組內所有 lane 都有完整區塊時壓縮
+	// drain = true ：壓縮組內所有剩下的完整區塊 (digestAll 用)
+	void compressGroup(size_t group, bool drain);
+	void compact(Lane & lane);
+};
+
+#endif
@@ -0,0 +1,351 @@
+#include "bench_suite.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <ostream>
+#include <random>
+#include <sstream>
+#include <system_error>
+#include "rsa.hpp"
+#include "serpent.hpp"
+#include "SHA256.h"
+#include "SHA256Multi.h"
+#include "thread_pool.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define BENCH_HAVE_TSC 1
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define BENCH_HAVE_TSC 1
+#endif
+
+namespace {
+
+uint64_t readTsc() {
+#ifdef BENCH_HAVE_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+// 避免編譯器把沒有被使用的結果整段省略
+volatile uint8_t g_sink;
+
+struct Measurement {
+    uint64_t iterations = 0;
+    double seconds = 0;
+    double cycles = 0;
+};
+
+// 重複執行 fn 直到至少經過 minSeconds 且至少 minIterations 次；
+// 每輪次數加倍，讀取時鐘的成本不會算進很小的工作量裡
+template <typename F>
+Measurement measure(double minSeconds, uint64_t minIterations, F&& fn) {
+    Measurement m;
+    uint64_t batch = 1;
+    auto start = std::chrono::steady_clock::now();
+    uint64_t tscStart = readTsc();
+    while (true) {
+        for (uint64_t i = 0; i < batch; i++) fn();
+        m.iterations += batch;
+        m.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (m.seconds >= minSeconds && m.iterations >= minIterations) break;
+        if (m.seconds < minSeconds / 16) batch *= 2;
+    }
+    m.cycles = static_cast<double>(readTsc() - tscStart);
+    return m;
+}
+
+// 以 JSON 寫出數值；沒有量到 (NaN / 無 TSC) 時輸出 null
+void jsonNumber(std::ostream& out, double v) {
+    if (std::isfinite(v)) out << v;
+    else out << "null";
+}
+
+double mbPerSecond(const Measurement& m, size_t bytes) {
+    return m.seconds > 0 ? m.iterations * static_cast<double>(bytes) / (1024.0 * 1024.0) / m.seconds : NAN;
+}
+
+double cyclesPerByte(const Measurement& m, size_t bytes) {
+#ifdef BENCH_HAVE_TSC
+    return m.iterations * bytes > 0 ? m.cycles / (static_cast<double>(m.iterations) * bytes) : NAN;
+#else
+    (void)m; (void)bytes;
+    return NAN;
+#endif
+}
+
+void throughputFields(std::ostream& out, const Measurement& m, size_t bytes) {
+    out << "\"bytes\": " << bytes << ", \"mb_per_s\": ";
+    jsonNumber(out, mbPerSecond(m, bytes));
+    out << ", \"cycles_per_byte\": ";
+    jsonNumber(out, cyclesPerByte(m, bytes));
+}
+
+const char* layoutName(Serpent::Layout l) {
+    return l == Serpent::Layout::Standard ? "Standard" : "Legacy";
+}
+
+void randomFill(std::vector<uint8_t>& buf, std::mt19937_64& rng) {
+    for (uint8_t& b : buf) b = static_cast<uint8_t>(rng());
+}
+
+// --- Serpent encryptBlocks：每個 backend / layout / 緩衝區大小各一筆 ---
+void benchSerpentBlocks(const BenchOptions& opt, std::ostream& out, std::ostream* progress, std::mt19937_64& rng) {
+    Serpent cipher;
+    cipher.setKey(random_bits(256));
+    const Serpent::Backend best = Serpent::detectBackend();
+
+    out << "  \"serpent_blocks\": [";
+    bool first = true;
+    for (int b = static_cast<int>(Serpent::Backend::Scalar); b <= static_cast<int>(best); b++) {
+        Serpent::Backend backend = static_cast<Serpent::Backend>(b);
+        cipher.setBackend(backend);
+        for (Serpent::Layout layout : { Serpent::Layout::Legacy, Serpent::Layout::Standard }) {
+            cipher.setLayout(layout);
+            for (size_t size : opt.blockSizes) {
+                size_t nblocks = size / 16;
+                if (nblocks == 0) continue;
+                std::vector<uint8_t> buf(nblocks * 16);
+                randomFill(buf, rng);
+                Measurement m = measure(opt.minSeconds, 1, [&]() {
+                    cipher.encryptBlocks(buf.data(), buf.data(), nblocks);
+                });
+                g_sink = buf[0];
+
+                out << (first ? "\n" : ",\n") << "    { \"backend\": \"" << Serpent::backendName(backend)
+                    << "\", \"layout\": \"" << layoutName(layout) << "\", ";
+                throughputFields(out, m, buf.size());
+                out << " }";
+                first = false;
+                if (progress) {
+                    *progress << "serpent " << Serpent::backendName(backend) << '/' << layoutName(layout)
+                              << ' ' << buf.size() << " B: " << mbPerSecond(m, buf.size()) << " MB/s" << std::endl;
+                }
+            }
+        }
+    }
+    out << "\n  ],\n";
+}
+
+// --- Serpent encryptFile：ECB、CTR、CTR + HMAC (選單與命令列預設使用的格式) ---
+bool benchSerpentFile(const BenchOptions& opt, std::ostream& out, std::ostream* progress, std::mt19937_64& rng) {
+    namespace fs = std::filesystem;
+    std::error_code ec;
+    fs::path dir = opt.tempDir.empty() ? fs::temp_directory_path(ec) : fs::path(opt.tempDir);
+    std::ostringstream tag;
+    tag << std::hex << rng();
+    const std::string inPath = (dir / ("serpent_bench_" + tag.str() + ".in")).string();
+    const std::string outPath = (dir / ("serpent_bench_" + tag.str() + ".out")).string();
+
+    struct FileMode { const char* name; Serpent::Mode mode; bool authenticated; };
+    const FileMode modes[] = {
+        { "ECB", Serpent::Mode::ECB, false },
+        { "CTR", Serpent::Mode::CTR, false },
+        { "CTR+HMAC", Serpent::Mode::CTR, true },
+    };
+    const std::vector<uint8_t> wrappedKey(128, 0x5A); // 只影響標頭長度
+
+    Serpent cipher;
+    cipher.setLayout(Serpent::Layout::Standard);
+    cipher.setThreadCount(opt.threads);
+    cipher.setKey(random_bits(256));
+
+    bool ok = true;
+    out << "  \"serpent_file\": [";
+    bool first = true;
+    for (size_t size : opt.fileSizes) {
+        {
+            std::vector<uint8_t> data(size);
+            randomFill(data, rng);
+            std::ofstream f(inPath, std::ios::binary | std::ios::trunc);
+            f.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+            if (!f) { ok = false; break; }
+        }
+        for (const FileMode& fm : modes) {
+            cipher.setMode(fm.mode);
+            cipher.setAuthenticated(fm.authenticated);
+            bool written = true;
+            Measurement m = measure(opt.minSeconds, 1, [&]() {
+                written = cipher.encryptFile(inPath, outPath, wrappedKey) && written;
+            });
+            if (!written) ok = false;
+
+            out << (first ? "\n" : ",\n") << "    { \"mode\": \"" << fm.name << "\", \"threads\": "
+                << cipher.getThreadCount() << ", ";
+            throughputFields(out, m, size);
+            out << " }";
+            first = false;
+            if (progress) {
+                *progress << "encryptFile " << fm.name << ' ' << size << " B: "
+                          << mbPerSecond(m, size) << " MB/s" << std::endl;
+            }
+        }
+    }
+    out << "\n  ],\n";
+
+    std::remove(inPath.c_str());
+    std::remove(outPath.c_str());
+    return ok;
+}
+
+// --- SHA256::update：每個 backend / 緩衝區大小各一筆 (含 digest 的收尾成本) ---
+void benchSHA256(const BenchOptions& opt, std::ostream& out, std::ostream* progress, std::mt19937_64& rng) {
+    std::vector<SHA256::Backend> backends = { SHA256::Backend::Scalar };
+    if (SHA256::detectBackend() != SHA256::Backend::Scalar) backends.push_back(SHA256::detectBackend());
+
+    out << "  \"sha256\": [";
+    bool first = true;
+    for (SHA256::Backend backend : backends) {
+        for (size_t size : opt.blockSizes) {
+            std::vector<uint8_t> buf(size);
+            randomFill(buf, rng);
+            Measurement m = measure(opt.minSeconds, 1, [&]() {
+                SHA256 sha;
+                sha.setBackend(backend);
+                sha.update(buf.data(), buf.size());
+                g_sink = sha.digest()[0];
+            });
+
+            out << (first ? "\n" : ",\n") << "    { \"backend\": \"" << SHA256::backendName(backend) << "\", ";
+            throughputFields(out, m, size);
+            out << " }";
+            first = false;
+            if (progress) {
+                *progress << "sha256 " << SHA256::backendName(backend) << ' ' << size << " B: "
+                          << mbPerSecond(m, size) << " MB/s" << std::endl;
+            }
+        }
+    }
+    out << "\n  ],\n";
+}
+
+// --- 大量小訊息：逐一 SHA256 (目前最快的 backend) 對照 SHA256Multi 的每個 backend ---
+// 每組 MULTI_MESSAGES 個相同長度的訊息，bytes 為整組的總量；
+// "lanes" 為 0 的那一筆是逐一呼叫 SHA256 (與 hash 指令處理大檔案的方式相同)
+void benchSHA256Multi(const BenchOptions& opt, std::ostream& out, std::ostream* progress, std::mt19937_64& rng) {
+    const size_t MULTI_MESSAGES = 256;
+
+    out << "  \"sha256_multi\": [";
+    bool first = true;
+    for (size_t size : opt.messageSizes) {
+        std::vector<std::vector<uint8_t>> messages(MULTI_MESSAGES, std::vector<uint8_t>(size));
+        for (std::vector<uint8_t>& msg : messages) randomFill(msg, rng);
+        const size_t total = MULTI_MESSAGES * size;
+
+        auto emit = [&](const std::string& backend, size_t lanes, const Measurement& m) {
+            out << (first ? "\n" : ",\n") << "    { \"backend\": \"" << backend << "\", \"lanes\": " << lanes
+                << ", \"messages\": " << MULTI_MESSAGES << ", \"message_bytes\": " << size << ", ";
+            throughputFields(out, m, total);
+            out << " }";
+            first = false;
+            if (progress) {
+                *progress << "sha256 " << MULTI_MESSAGES << " x " << size << " B, " << backend << ": "
+                          << mbPerSecond(m, total) << " MB/s" << std::endl;
+            }
+        };
+
+        Measurement single = measure(opt.minSeconds, 1, [&]() {
+            for (const std::vector<uint8_t>& msg : messages) {
+                SHA256 sha;
+                sha.update(msg.data(), msg.size());
+                g_sink = sha.digest()[0];
+            }
+        });
+        emit(std::string("single-") + SHA256::backendName(SHA256::detectBackend()), 0, single);
+
+        for (int b = static_cast<int>(SHA256Multi::Backend::Scalar);
+             b <= static_cast<int>(SHA256Multi::detectBackend()); b++) {
+            SHA256Multi multi(MULTI_MESSAGES);
+            multi.setBackend(static_cast<SHA256Multi::Backend>(b));
+            Measurement m = measure(opt.minSeconds, 1, [&]() {
+                for (size_t lane = 0; lane < MULTI_MESSAGES; lane++) {
+                    multi.update(lane, messages[lane].data(), messages[lane].size());
+                }
+                g_sink = multi.digestAll()[0][0];
+            });
+            emit(SHA256Multi::backendName(multi.getBackend()), SHA256Multi::backendWidth(multi.getBackend()), m);
+        }
+    }
+    out << "\n  ],\n";
+}
+
+// --- RSA：keygen / encrypt / decrypt (以 RSAContext，與實際加解密相同路徑) ---
+// 某個位元數失敗 (例如小於 RSA_MIN_BITS) 時略過該筆、印出原因並回傳 false，JSON 仍保持完整
+bool benchRSA(const BenchOptions& opt, std::ostream& out, std::ostream* progress) {
+    out << "  \"rsa\": [";
+    bool first = true;
+    bool ok = true;
+    for (size_t bits : opt.rsaBits) {
+        RSAKey key;
+        Measurement keygen;
+        RSAContext ctx;
+        try {
+            keygen = measure(opt.minSeconds, 1, [&]() { key = rsa_keygen(bits); });
+            ctx = rsa_context(key);
+        } catch (const std::exception& e) {
+            if (progress) *progress << "rsa " << bits << ": " << e.what() << std::endl;
+            ok = false;
+            continue;
+        }
+
+        mpz_class msg = random_bits(256);
+        mpz_class c = rsa_encrypt(msg, ctx);
+        Measurement enc = measure(opt.minSeconds, 1, [&]() { c = rsa_encrypt(msg, ctx); });
+        mpz_class back;
+        Measurement dec = measure(opt.minSeconds, 1, [&]() { back = rsa_decrypt(c, ctx); });
+
+        auto opsPerSecond = [](const Measurement& m) { return m.seconds > 0 ? m.iterations / m.seconds : NAN; };
+        out << (first ? "\n" : ",\n") << "    { \"bits\": " << bits << ", \"keygen_ops_per_s\": ";
+        jsonNumber(out, opsPerSecond(keygen));
+        out << ", \"encrypt_ops_per_s\": ";
+        jsonNumber(out, opsPerSecond(enc));
+        out << ", \"decrypt_ops_per_s\": ";
+        jsonNumber(out, opsPerSecond(dec));
+        out << ", \"crt\": " << (ctx.crt ? "true" : "false") << ", \"verified\": " << (back == msg ? "true" : "false")
+            << " }";
+        first = false;
+        if (progress) {
+            *progress << "rsa " << bits << ": keygen " << opsPerSecond(keygen) << " ops/s, encrypt "
+                      << opsPerSecond(enc) << " ops/s, decrypt " << opsPerSecond(dec) << " ops/s" << std::endl;
+        }
+    }
+    out << "\n  ]\n";
+    return ok;
+}
+
+} // namespace
+
+bool runBenchSuite(const BenchOptions& opt, std::ostream& out, std::ostream* progress) {
+    std::mt19937_64 rng(std::random_device{}());
+    std::ios::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    out << std::fixed << std::setprecision(3);
+
+#ifdef BENCH_HAVE_TSC
+    const bool tsc = true;
+#else
+    const bool tsc = false;
+#endif
+    out << "{\n  \"version\": 1,\n  \"threads\": " << ThreadPool::defaultThreadCount()
+        << ",\n  \"tsc\": " << (tsc ? "true" : "false") << ",\n";
+
+    benchSerpentBlocks(opt, out, progress, rng);
+    bool ok = benchSerpentFile(opt, out, progress, rng);
+    benchSHA256(opt, out, progress, rng);
+    benchSHA256Multi(opt, out, progress, rng);
+    ok = benchRSA(opt, out, progress) && ok;
+    out << "}" << std::endl;
+
+    out.flags(flags);
+    out.precision(precision);
+    return ok;
+}
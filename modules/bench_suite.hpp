@@ -0,0 +1,34 @@
+#ifndef BENCH_SUITE_HPP
+#define BENCH_SUITE_HPP
+
+#include <cstddef>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+// 效能量測：Serpent (區塊 / 檔案)、SHA-256、RSA，結果輸出成 JSON，方便在不同版本之間比較。
+// 每一項至少執行 minSeconds (RSA keygen 至少一次)，取平均；x86 上另外以 TSC 換算 cycles/byte
+// (TSC 頻率不一定等於實際核心頻率，只適合同一台機器前後比較，其他平台輸出 null)。
+//
+// JSON 結構：
+//   { "version": 1, "threads": N, "tsc": true,
+//     "serpent_blocks": [ { "backend", "layout", "bytes", "mb_per_s", "cycles_per_byte" } ],
+//     "serpent_file"  : [ { "mode", "bytes", "threads", "mb_per_s", "cycles_per_byte" } ],
+//     "sha256"        : [ { "backend", "bytes", "mb_per_s", "cycles_per_byte" } ],
+//     "sha256_multi"  : [ { "backend", "lanes", "messages", "message_bytes", "bytes", "mb_per_s", "cycles_per_byte" } ],
+//     "rsa"           : [ { "bits", "keygen_ops_per_s", "encrypt_ops_per_s", "decrypt_ops_per_s" } ] }
+struct BenchOptions {
+    std::vector<size_t> blockSizes = { 16, 4096, 64 << 10, 1 << 20 };      // encryptBlocks / SHA256::update 的緩衝區大小
+    std::vector<size_t> fileSizes = { 64 << 10, 1 << 20, 16 << 20 };       // encryptFile 的檔案大小
+    std::vector<size_t> messageSizes = { 256, 4096, 64 << 10 };            // sha256_multi 每個訊息的大小
+    std::vector<size_t> rsaBits = { 1024, 2048, 4096 };
+    double minSeconds = 0.5;
+    unsigned threads = 0;       // encryptFile 使用的執行緒數，0 代表全部核心
+    std::string tempDir;        // 暫存檔目錄，空字串代表系統暫存目錄
+};
+
+// 執行全部量測並把 JSON 寫到 out；progress 不為 nullptr 時每完成一項輸出一行進度
+// 暫存檔無法建立，或某個 RSA 位元數無法產生金鑰時回傳 false (其餘項目仍會輸出)
+bool runBenchSuite(const BenchOptions& opt, std::ostream& out, std::ostream* progress = nullptr);
+
+#endif
@@ -0,0 +1,240 @@
+#include "bulk_crypt.hpp"
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <system_error>
+#include "SHA256.h"
+#include "SHA256Multi.h"
+#include "thread_pool.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const char* const CONTAINER_EXT = ".serpent";
+
+struct Job {
+    std::string src;   // 完整路徑
+    std::string dst;
+    uint64_t size;
+    size_t index;      // 在 BulkReport::files 中的位置
+};
+
+// 加密 / 解密後的輸出檔名
+std::string outputName(const std::string& name, bool decrypt) {
+    if (!decrypt) return name + CONTAINER_EXT;
+    const size_t extLen = std::char_traits<char>::length(CONTAINER_EXT);
+    if (name.size() > extLen && name.compare(name.size() - extLen, extLen, CONTAINER_EXT) == 0) {
+        return name.substr(0, name.size() - extLen);
+    }
+    return name + ".dec";
+}
+
+// 走訪來源目錄，先建好所有輸出子目錄 (之後 worker 不必各自呼叫 create_directories)
+bool collectJobs(const fs::path& srcRoot, const fs::path& dstRoot, bool decrypt,
+                 std::vector<Job>& jobs, BulkReport& report) {
+    std::error_code ec;
+    fs::create_directories(dstRoot, ec);
+    if (ec) return false;
+
+    // 輸出目錄在來源目錄之下時不能走進去，否則會處理到自己剛產生的檔案
+    fs::path dstCanon = fs::weakly_canonical(dstRoot, ec);
+
+    fs::recursive_directory_iterator it(srcRoot, fs::directory_options::skip_permission_denied, ec);
+    if (ec) return false;
+
+    for (; it != fs::recursive_directory_iterator(); it.increment(ec)) {
+        if (ec) break;
+        const fs::directory_entry& entry = *it;
+        fs::path rel = entry.path().lexically_relative(srcRoot);
+
+        std::error_code statEc;
+        if (entry.is_directory(statEc)) {
+            if (fs::equivalent(entry.path(), dstCanon, statEc)) {
+                it.disable_recursion_pending();
+                continue;
+            }
+            fs::create_directories(dstRoot / rel, statEc);
+            continue;
+        }
+        if (!entry.is_regular_file(statEc)) continue;
+
+        BulkFileResult r;
+        r.path = rel.generic_string();
+        r.bytes = entry.file_size(statEc);
+        r.plainHash.fill(0);
+
+        Job job;
+        job.src = entry.path().string();
+        job.dst = (dstRoot / rel.parent_path() / outputName(rel.filename().string(), decrypt)).string();
+        job.size = r.bytes;
+        job.index = report.files.size();
+        jobs.push_back(job);
+        report.files.push_back(r);
+    }
+    return !ec;
+}
+
+// 處理單一檔案 (在 worker 上執行，不可拋出例外)
+// onPlain 為空時自行以 SHA256 計算明文雜湊並填入 r.plainHash；
+// 否則明文交給 onPlain (SHA256Multi 的 lane)，由呼叫端在整批結束後填入
+void processFile(const Job& job, bool decrypt, const RSAContext& ctx, const BulkOptions& opt,
+                 unsigned serpentThreads, BulkFileResult& r, const Serpent::ByteSink& onPlain = Serpent::ByteSink()) {
+    auto start = std::chrono::steady_clock::now();
+    try {
+        Serpent cipher;
+        cipher.setThreadCount(serpentThreads);
+        cipher.setChunkSize(opt.chunkSize);
+        SHA256 plainHash;
+        Serpent::ByteSink sink = onPlain;
+        if (!sink) sink = [&plainHash](const uint8_t* p, size_t n) { plainHash.update(p, n); };
+        bool ok;
+
+        if (!decrypt) {
+            mpz_class sessionKey = random_bits(256);
+            std::vector<unsigned char> wrapped = rsa_mpz_to_bytes(rsa_encrypt(sessionKey, ctx));
+            cipher.setMode(Serpent::Mode::CTR);
+            cipher.setLayout(Serpent::Layout::Standard);
+            cipher.setAuthenticated(true);
+            cipher.setKey(sessionKey);
+            ok = cipher.encryptFile(job.src, job.dst, wrapped, sink, nullptr);
+        } else {
+            Serpent::ContainerHeader header;
+            if (!Serpent::readContainerHeader(job.src, header)) {
+                r.status = BulkFileResult::Status::Skipped;
+                r.message = "不是加密容器檔";
+                return;
+            }
+            cipher.setKey(rsa_decrypt(rsa_mpz_from_bytes(header.wrappedKey), ctx));
+            ok = cipher.decryptFile(job.src, job.dst, sink, nullptr);
+        }
+
+        if (ok) {
+            r.status = BulkFileResult::Status::Ok;
+            if (!onPlain) r.plainHash = plainHash.digest();
+        } else {
+            r.status = BulkFileResult::Status::Failed;
+            r.message = decrypt ? "解密失敗 (驗證碼不符或檔案損毀)" : "加密失敗 (讀寫錯誤)";
+        }
+    } catch (const std::exception& e) {
+        r.status = BulkFileResult::Status::Failed;
+        r.message = e.what();
+    }
+    r.millis = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+BulkReport runBulk(const std::string& srcDir, const std::string& dstDir, bool decrypt,
+                   const RSAContext& ctx, const BulkOptions& opt) {
+    auto start = std::chrono::steady_clock::now();
+    BulkReport report;
+    std::vector<Job> jobs;
+    if (!collectJobs(srcDir, dstDir, decrypt, jobs, report)) {
+        BulkFileResult r;
+        r.path = srcDir;
+        r.message = "無法走訪來源目錄或建立輸出目錄";
+        r.plainHash.fill(0);
+        report.files.push_back(r);
+    }
+
+    // 已經是檔案層級的平行，單次 RSA 解密不必再把 CRT 兩半拆到兩條執行緒
+    RSAContext workerCtx = ctx;
+    workerCtx.parallel_crt = false;
+
+    const unsigned threads = opt.threads ? opt.threads : ThreadPool::defaultThreadCount();
+
+    // 1. 大檔案：一次一個，檔案內依 chunk 平行
+    for (const Job& job : jobs) {
+        if (job.size >= opt.largeFileThreshold) {
+            processFile(job, decrypt, ctx, opt, threads, report.files[job.index]);
+        }
+    }
+
+    // 2. 其餘檔案：打包成批，一批交給一條執行緒
+    //    批次內不超過 SHA256Multi::MAX_PENDING 的檔案各占一個 lane，明文雜湊在整批結束後一起以 SIMD 算完
+    //    (multi-buffer 不比單一 SHA256 快的 CPU 上仍逐一計算)
+    {
+        ThreadPool pool(threads);
+        std::vector<const Job*> batch;
+        uint64_t batchBytes = 0;
+        const bool multiHash = SHA256Multi::fasterThanSingle();
+        auto flush = [&]() {
+            if (batch.empty()) return;
+            pool.submit([batch, decrypt, multiHash, &workerCtx, &opt, &report]() {
+                SHA256Multi hasher(batch.size());
+                std::vector<char> useLane(batch.size(), 0);
+                for (size_t lane = 0; lane < batch.size(); lane++) {
+                    const Job* job = batch[lane];
+                    Serpent::ByteSink sink;
+                    // 加密檔比明文大，以輸入檔大小判斷即可涵蓋解密的情況
+                    if (multiHash && job->size <= SHA256Multi::MAX_PENDING) {
+                        useLane[lane] = 1;
+                        sink = [&hasher, lane](const uint8_t* p, size_t n) { hasher.update(lane, p, n); };
+                    }
+                    processFile(*job, decrypt, workerCtx, opt, 1, report.files[job->index], sink);
+                }
+                std::vector<std::array<uint8_t, 32>> digests = hasher.digestAll();
+                for (size_t lane = 0; lane < batch.size(); lane++) {
+                    BulkFileResult& r = report.files[batch[lane]->index];
+                    if (useLane[lane] && r.status == BulkFileResult::Status::Ok) r.plainHash = digests[lane];
+                }
+            });
+            batch.clear();
+            batchBytes = 0;
+        };
+        for (const Job& job : jobs) {
+            if (job.size >= opt.largeFileThreshold) continue;
+            batch.push_back(&job);
+            batchBytes += job.size;
+            if (batch.size() >= opt.batchFiles || batchBytes >= opt.batchBytes) flush();
+        }
+        flush();
+        pool.wait();
+    }
+
+    for (const BulkFileResult& r : report.files) {
+        switch (r.status) {
+            case BulkFileResult::Status::Ok:      report.ok++; report.bytes += r.bytes; break;
+            case BulkFileResult::Status::Failed:  report.failed++; break;
+            case BulkFileResult::Status::Skipped: report.skipped++; break;
+        }
+    }
+    report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return report;
+}
+
+} // namespace
+
+const char* BulkReport::statusName(BulkFileResult::Status s) {
+    switch (s) {
+        case BulkFileResult::Status::Ok:      return "ok";
+        case BulkFileResult::Status::Skipped: return "skipped";
+        default:                              return "failed";
+    }
+}
+
+bool BulkReport::write(const std::string& path) const {
+    std::ofstream out(path);
+    if (!out) return false;
+
+    out << "status\tbytes\tmillis\tsha256\tpath\tmessage\n";
+    out << std::fixed << std::setprecision(3);
+    for (const BulkFileResult& r : files) {
+        out << statusName(r.status) << '\t' << r.bytes << '\t' << r.millis << '\t'
+            << (r.status == BulkFileResult::Status::Ok ? SHA256::toString(r.plainHash) : "-") << '\t'
+            << r.path << '\t' << r.message << '\n';
+    }
+    return static_cast<bool>(out);
+}
+
+BulkReport bulkEncryptDirectory(const std::string& srcDir, const std::string& dstDir,
+                                const RSAContext& ctx, const BulkOptions& opt) {
+    return runBulk(srcDir, dstDir, false, ctx, opt);
+}
+
+BulkReport bulkDecryptDirectory(const std::string& srcDir, const std::string& dstDir,
+                                const RSAContext& ctx, const BulkOptions& opt) {
+    return runBulk(srcDir, dstDir, true, ctx, opt);
+}
@@ -0,0 +1,60 @@
+#ifndef BULK_CRYPT_HPP
+#define BULK_CRYPT_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "rsa.hpp"
+#include "serpent.hpp"
+
+// 整個目錄樹的批次加解密
+// 遞迴走訪來源目錄，在輸出目錄建立相同的子目錄結構，每個檔案各自產生一個容器檔
+// (各自的 Session Key，以 RSA 公鑰包裝；CTR + HMAC，與選單 / 命令列的單檔加密相同)。
+// 排程方式：
+//   - 大檔案 (>= largeFileThreshold) 逐一處理，單一檔案內部依 chunk 分給所有執行緒；
+//   - 其餘檔案依走訪順序打包成批 (約 batchBytes 或 batchFiles 個)，每批交給 ThreadPool 的一條執行緒，
+//     批內的檔案在同一條執行緒上依序處理，不再各自開執行緒，避免大量小檔案時排程成本高過加密本身。
+// 每個檔案的結果 (成功/失敗/略過、大小、耗時、明文 SHA-256) 收集在 BulkReport，可寫成 TSV 報表。
+struct BulkOptions {
+    unsigned threads = 0;                            // 0 代表全部核心
+    size_t chunkSize = Serpent::DEFAULT_CHUNK_SIZE;  // Serpent 串流處理的單位
+    uint64_t largeFileThreshold = 8ULL << 20;        // 達到此大小的檔案改用 chunk 平行
+    uint64_t batchBytes = 4ULL << 20;                // 小檔案每批大約的總大小
+    size_t batchFiles = 256;                         // 小檔案每批最多的檔案數
+};
+
+struct BulkFileResult {
+    enum class Status { Ok, Failed, Skipped };
+
+    std::string path;                  // 相對於來源目錄
+    uint64_t bytes = 0;                // 來源檔案大小
+    Status status = Status::Failed;
+    std::string message;               // 失敗 / 略過的原因
+    double millis = 0;                 // 處理耗時
+    std::array<uint8_t, 32> plainHash; // 明文 SHA-256 (加密時為來源，解密時為輸出)
+};
+
+struct BulkReport {
+    std::vector<BulkFileResult> files; // 依走訪順序
+    size_t ok = 0, failed = 0, skipped = 0;
+    uint64_t bytes = 0;                // 成功處理的來源總大小
+    double seconds = 0;                // 含走訪目錄的總耗時
+
+    // TSV：status  bytes  millis  sha256  path  message (第一行為欄位名稱)
+    bool write(const std::string& path) const;
+    static const char* statusName(BulkFileResult::Status s);
+};
+
+// 加密 srcDir 下的所有檔案到 dstDir (檔名加上 ".serpent")；dstDir 位於 srcDir 之下時會自動略過
+// 只需要公鑰 (ctx.key.n / e)
+BulkReport bulkEncryptDirectory(const std::string& srcDir, const std::string& dstDir,
+                                const RSAContext& ctx, const BulkOptions& opt);
+
+// 解密 srcDir 下的所有容器檔到 dstDir (去掉 ".serpent"，沒有此副檔名時加上 ".dec")；
+// 不是容器檔的檔案記為略過。HMAC 不符的檔案記為失敗，且不會留下輸出檔
+BulkReport bulkDecryptDirectory(const std::string& srcDir, const std::string& dstDir,
+                                const RSAContext& ctx, const BulkOptions& opt);
+
+#endif
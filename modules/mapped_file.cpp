@@ -0,0 +1,118 @@
+#include "mapped_file.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MAPPED_FILE_POSIX 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile() : base(nullptr), length(0), fd(-1), writable(false) {}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+bool MappedFile::supported() {
+#ifdef MAPPED_FILE_POSIX
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool MappedFile::openRead(const std::string& path) {
+    close();
+#ifdef MAPPED_FILE_POSIX
+    fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close();
+        return false;
+    }
+
+    void* p = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+        close();
+        return false;
+    }
+    madvise(p, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+
+    base = static_cast<uint8_t*>(p);
+    length = static_cast<uint64_t>(st.st_size);
+    writable = false;
+    return true;
+#else
+    (void)path;
+    return false;
+#endif
+}
+
+bool MappedFile::createWrite(const std::string& path, uint64_t size, const MappedFile* source) {
+    close();
+#ifdef MAPPED_FILE_POSIX
+    if (size == 0) return false;
+
+    // 必須在 O_TRUNC 之前檢查：目的檔不存在時 stat 失敗，一定不是同一個檔案
+    if (source != nullptr && source->fd >= 0) {
+        struct stat dst, src;
+        if (::stat(path.c_str(), &dst) == 0 && fstat(source->fd, &src) == 0 &&
+            dst.st_dev == src.st_dev && dst.st_ino == src.st_ino) {
+            return false;
+        }
+    }
+
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return false;
+
+    // 先把檔案撐到最終大小，映射後才能直接寫入
+    if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+        close();
+        return false;
+    }
+
+    void* p = mmap(nullptr, static_cast<size_t>(size), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+        close();
+        return false;
+    }
+    madvise(p, static_cast<size_t>(size), MADV_SEQUENTIAL);
+
+    base = static_cast<uint8_t*>(p);
+    length = size;
+    writable = true;
+    return true;
+#else
+    (void)path;
+    (void)size;
+    (void)source;
+    return false;
+#endif
+}
+
+bool MappedFile::close() {
+    return closeWithSize(length);
+}
+
+bool MappedFile::closeWithSize(uint64_t finalSize) {
+    bool ok = true;
+#ifdef MAPPED_FILE_POSIX
+    if (base != nullptr) {
+        if (munmap(base, static_cast<size_t>(length)) != 0) ok = false;
+    }
+    if (fd >= 0) {
+        if (writable && finalSize != length && ftruncate(fd, static_cast<off_t>(finalSize)) != 0) ok = false;
+        if (::close(fd) != 0) ok = false;
+    }
+#else
+    (void)finalSize;
+#endif
+    base = nullptr;
+    length = 0;
+    fd = -1;
+    writable = false;
+    return ok;
+}
@@ -0,0 +1,49 @@
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// 記憶體映射檔案 (mmap)
+// 讀取端直接從 page cache 取資料，不必把整個檔案 read 進 heap；
+// 寫入端先用 ftruncate 把檔案撐到最終大小再映射，加密結果直接寫進檔案頁面。
+// 只在 POSIX 平台 (Linux / macOS) 啟用；其他平台 supported() 回傳 false，
+// 所有 open 都會失敗，呼叫端應改走原本的 fstream 串流路徑。
+class MappedFile {
+public:
+    MappedFile();
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    static bool supported();
+
+    // 唯讀映射整個檔案，並提示核心循序讀取 (MADV_SEQUENTIAL)
+    // 空檔案無法映射，會回傳 false
+    bool openRead(const std::string& path);
+
+    // 建立 (或截斷) 檔案為 size bytes 並映射為可寫，size 必須大於 0
+    // source：正在讀取的映射；path 與它是同一個檔案 (同 device / inode) 時不截斷，直接回傳 false，
+    //         避免截斷後 source 的頁面失效 (讀到 0 或 SIGBUS)
+    bool createWrite(const std::string& path, uint64_t size, const MappedFile* source = nullptr);
+
+    // 解除映射並關閉檔案；寫入模式下可指定最終大小 (例如解密後去掉 Padding)
+    // 回傳 false 代表寫回或截斷失敗
+    bool close();
+    bool closeWithSize(uint64_t finalSize);
+
+    bool isOpen() const { return base != nullptr; }
+    const uint8_t* data() const { return base; }
+    uint8_t* data() { return base; }
+    uint64_t size() const { return length; }
+
+private:
+    uint8_t* base;
+    uint64_t length;
+    int fd;
+    bool writable;
+};
+
+#endif
@@ -0,0 +1,159 @@
+#include "metrics.hpp"
+
+#include <fstream>
+#include <iomanip>
+#include <ostream>
+
+namespace {
+
+// 對數-線性分格：0~7 ns 各一格，之後每個 2 的次方分成 SUB 格
+const unsigned SUB_BITS = 3;
+const uint64_t SUB = 1u << SUB_BITS;
+const size_t BUCKETS = (64 - SUB_BITS + 1) * SUB;
+
+struct StageData {
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> sumNanos{0};
+    std::atomic<uint64_t> buckets[BUCKETS];
+
+    StageData() {
+        for (std::atomic<uint64_t>& b : buckets) b.store(0, std::memory_order_relaxed);
+    }
+};
+
+StageData g_stages[Metrics::STAGE_COUNT];
+
+unsigned highestBit(uint64_t v) {
+    unsigned n = 0;
+    while (v >>= 1) n++;
+    return n;
+}
+
+size_t bucketIndex(uint64_t nanos) {
+    if (nanos < SUB) return static_cast<size_t>(nanos);
+    unsigned e = highestBit(nanos);                              // >= SUB_BITS
+    uint64_t mantissa = (nanos >> (e - SUB_BITS)) & (SUB - 1);   // 最高位之後的 SUB_BITS 位
+    return static_cast<size_t>((e - SUB_BITS + 1) * SUB + mantissa);
+}
+
+// 格子內最大的值 (含)
+uint64_t bucketUpper(size_t index) {
+    if (index < SUB) return index;
+    unsigned e = static_cast<unsigned>(index / SUB) + SUB_BITS - 1;
+    uint64_t mantissa = index % SUB;
+    uint64_t lower = (SUB + mantissa) << (e - SUB_BITS);
+    return lower + ((uint64_t(1) << (e - SUB_BITS)) - 1);
+}
+
+StageData& data(Metrics::Stage stage) {
+    return g_stages[static_cast<size_t>(stage)];
+}
+
+} // namespace
+
+std::atomic<bool> Metrics::s_enabled{false};
+
+void Metrics::setEnabled(bool on) {
+    s_enabled.store(on, std::memory_order_relaxed);
+}
+
+void Metrics::record(Stage stage, uint64_t nanos, uint64_t bytes) {
+    StageData& d = data(stage);
+    d.count.fetch_add(1, std::memory_order_relaxed);
+    d.bytes.fetch_add(bytes, std::memory_order_relaxed);
+    d.sumNanos.fetch_add(nanos, std::memory_order_relaxed);
+    d.buckets[bucketIndex(nanos)].fetch_add(1, std::memory_order_relaxed);
+}
+
+void Metrics::reset() {
+    for (StageData& d : g_stages) {
+        d.count.store(0, std::memory_order_relaxed);
+        d.bytes.store(0, std::memory_order_relaxed);
+        d.sumNanos.store(0, std::memory_order_relaxed);
+        for (std::atomic<uint64_t>& b : d.buckets) b.store(0, std::memory_order_relaxed);
+    }
+}
+
+uint64_t Metrics::count(Stage stage) {
+    return data(stage).count.load(std::memory_order_relaxed);
+}
+
+uint64_t Metrics::bytes(Stage stage) {
+    return data(stage).bytes.load(std::memory_order_relaxed);
+}
+
+uint64_t Metrics::quantileNanos(Stage stage, double q) {
+    const StageData& d = data(stage);
+    uint64_t total = 0;
+    for (const std::atomic<uint64_t>& b : d.buckets) total += b.load(std::memory_order_relaxed);
+    if (total == 0) return 0;
+
+    uint64_t rank = static_cast<uint64_t>(q * total);
+    if (rank >= total) rank = total - 1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; i++) {
+        seen += d.buckets[i].load(std::memory_order_relaxed);
+        if (seen > rank) return bucketUpper(i);
+    }
+    return bucketUpper(BUCKETS - 1);
+}
+
+const char* Metrics::stageName(Stage stage) {
+    switch (stage) {
+        case Stage::RsaEncrypt:         return "rsa_encrypt";
+        case Stage::RsaDecrypt:         return "rsa_decrypt";
+        case Stage::SerpentEncryptFile: return "serpent_encrypt_file";
+        case Stage::SerpentDecryptFile: return "serpent_decrypt_file";
+        case Stage::SerpentRead:        return "serpent_read";
+        case Stage::SerpentCrypt:       return "serpent_crypt";
+        case Stage::SerpentWrite:       return "serpent_write";
+        case Stage::SerpentDigest:      return "serpent_digest";
+        case Stage::Sha256Update:       return "sha256_update";
+        default:                        return "unknown";
+    }
+}
+
+void Metrics::writePrometheus(std::ostream& out) {
+    std::ios::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    out << std::setprecision(9);
+
+    out << "# HELP crypto_stage_seconds Latency of each instrumented stage.\n"
+        << "# TYPE crypto_stage_seconds histogram\n";
+    for (size_t s = 0; s < STAGE_COUNT; s++) {
+        const StageData& d = g_stages[s];
+        const char* name = stageName(static_cast<Stage>(s));
+
+        // 直方圖是累計值；空的格子不影響累計結果，省略不印
+        uint64_t cumulative = 0;
+        for (size_t i = 0; i < BUCKETS; i++) {
+            uint64_t n = d.buckets[i].load(std::memory_order_relaxed);
+            if (n == 0) continue;
+            cumulative += n;
+            out << "crypto_stage_seconds_bucket{stage=\"" << name << "\",le=\""
+                << bucketUpper(i) * 1e-9 << "\"} " << cumulative << "\n";
+        }
+        out << "crypto_stage_seconds_bucket{stage=\"" << name << "\",le=\"+Inf\"} " << cumulative << "\n"
+            << "crypto_stage_seconds_sum{stage=\"" << name << "\"} "
+            << d.sumNanos.load(std::memory_order_relaxed) * 1e-9 << "\n"
+            << "crypto_stage_seconds_count{stage=\"" << name << "\"} " << cumulative << "\n";
+    }
+
+    out << "# HELP crypto_stage_bytes_total Bytes processed by each instrumented stage.\n"
+        << "# TYPE crypto_stage_bytes_total counter\n";
+    for (size_t s = 0; s < STAGE_COUNT; s++) {
+        out << "crypto_stage_bytes_total{stage=\"" << stageName(static_cast<Stage>(s)) << "\"} "
+            << g_stages[s].bytes.load(std::memory_order_relaxed) << "\n";
+    }
+
+    out.flags(flags);
+    out.precision(precision);
+}
+
+bool Metrics::writePrometheus(const std::string& path) {
+    std::ofstream out(path);
+    if (!out) return false;
+    writePrometheus(out);
+    return static_cast<bool>(out.flush());
+}
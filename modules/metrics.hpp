@@ -0,0 +1,89 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+
+// 熱路徑量測：每個階段 (stage) 累計呼叫次數、處理的 bytes 與總耗時，
+// 並以 HDR 風格的對數-線性直方圖記錄每次的延遲 (每個 2 的次方再細分 8 格，相對誤差 < 12.5%)，
+// 數值全部是 relaxed atomic，多條執行緒可以同時記錄，不需要鎖。
+//
+// 預設關閉：關閉時 StageTimer 只讀一次 atomic<bool>，不讀時鐘也不寫任何共用資料；
+// 編譯時定義 CRYPTO_NO_METRICS 則 enabled() 固定為 false，整段量測程式碼會被最佳化掉。
+//
+// RSA 與整個檔案的階段只記錄次數與耗時 (bytes 為 0)；檔案大小由 serpent_crypt / serpent_write 的 bytes 取得。
+// mmap 路徑的讀取是 page fault，發生在 serpent_crypt 之內；
+// 寫出則在解除映射 (msync / munmap / ftruncate) 時計入 serpent_write。
+class Metrics {
+public:
+    enum class Stage {
+        RsaEncrypt,          // rsa_encrypt
+        RsaDecrypt,          // rsa_decrypt (批次解密的每一筆也會計入)
+        SerpentEncryptFile,  // Serpent::encryptFile 整體
+        SerpentDecryptFile,  // Serpent::decryptFile 整體
+        SerpentRead,         // 串流路徑讀取一個 chunk
+        SerpentCrypt,        // 一個 chunk 的加解密 (worker 上)
+        SerpentWrite,        // 串流路徑寫出一個 chunk / mmap 路徑解除映射
+        SerpentDigest,       // 依檔案順序呼叫 SHA-256 / HMAC callback
+        Sha256Update,        // SHA256::update (HMAC 內部的呼叫也會計入)
+        Count
+    };
+    static constexpr size_t STAGE_COUNT = static_cast<size_t>(Stage::Count);
+
+    static void setEnabled(bool on);
+#ifdef CRYPTO_NO_METRICS
+    static constexpr bool enabled() { return false; }
+#else
+    static bool enabled() { return s_enabled.load(std::memory_order_relaxed); }
+#endif
+
+    static void record(Stage stage, uint64_t nanos, uint64_t bytes);
+    static void reset();
+
+    // 某階段的累計值；quantileNanos 由直方圖估計 (回傳所在格子的上界)，沒有資料時為 0
+    static uint64_t count(Stage stage);
+    static uint64_t bytes(Stage stage);
+    static uint64_t quantileNanos(Stage stage, double q);
+
+    // Prometheus text exposition format：
+    //   crypto_stage_seconds (histogram，label stage，只列出有資料的格子) 與 crypto_stage_bytes_total (counter)
+    static void writePrometheus(std::ostream& out);
+    static bool writePrometheus(const std::string& path);
+
+    static const char* stageName(Stage stage);
+
+private:
+    static std::atomic<bool> s_enabled;
+};
+
+// 在建構到解構之間量測一個階段；bytes 可在結束前以 addBytes 補上
+class StageTimer {
+public:
+    explicit StageTimer(Metrics::Stage stage, uint64_t bytes = 0)
+        : stage(stage), bytes(bytes), active(Metrics::enabled()) {
+        if (active) start = std::chrono::steady_clock::now();
+    }
+    ~StageTimer() {
+        if (active) {
+            auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+            Metrics::record(stage, static_cast<uint64_t>(nanos.count()), bytes);
+        }
+    }
+
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+
+    void addBytes(uint64_t n) { bytes += n; }
+
+private:
+    Metrics::Stage stage;
+    uint64_t bytes;
+    bool active;
+    std::chrono::steady_clock::time_point start;
+};
+
+#endif
@@ -1,13 +1,27 @@
 #include "rsa.hpp"
+#include "thread_pool.hpp"
+#include "metrics.hpp"
 #include <stdexcept>
-#include <ctime>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <exception>
+#include <future>
+#include <iostream>
+#include <random>
 
 static gmp_randclass& global_rng() {
-  static gmp_randclass rng(gmp_randinit_default);
-  static bool seeded = false;
+  // 每條執行緒各自一個 RNG：gmp_randclass 不是 thread-safe，
+  // 而且 p、q 會在不同執行緒同時搜尋，不能用相同的時間 seed（會找到同一個質數）
+  thread_local gmp_randclass rng(gmp_randinit_default);
+  thread_local bool seeded = false;
   if (!seeded) {
-    // 期末作業 demo 用時間 seed（可用 /dev/urandom 改更安全）
-    rng.seed(static_cast<unsigned long>(std::time(nullptr)));
+    std::random_device rd;
+    mpz_class seed = 0;
+    for (int i = 0; i < 8; i++) seed = (seed << 32) | rd();
+    rng.seed(seed);
     seeded = true;
   }
   return rng;
@@ -21,29 +35,57 @@ mpz_class random_bits(std::size_t bits) {
   return x;
 }
 
+// 小質數表（3 ~ 65535），篩法用
+static const std::vector<unsigned long>& small_primes() {
+  static const std::vector<unsigned long> primes = [] {
+    const unsigned long limit = 1UL << 16;
+    std::vector<bool> composite(limit, false);
+    std::vector<unsigned long> out;
+    for (unsigned long i = 3; i < limit; i += 2) {
+      if (composite[i]) continue;
+      out.push_back(i);
+      for (unsigned long j = i * i; j < limit; j += 2 * i) composite[j] = true;
+    }
+    return out;
+  }();
+  return primes;
+}
+
 //產生質數
+// 從隨機奇數 x 開始，先用小質數篩掉視窗 x, x+2, ..., x+2(W-1) 中的合數，
+// 只對篩剩的候選做 Miller-Rabin；整個視窗都不是質數就往後移一個視窗。
+// 大約 9 成的候選會被篩掉，省下大部分昂貴的模指數運算。
 static mpz_class next_prime_of_bits(std::size_t bits) {
-  mpz_class x = random_bits(bits);
-  mpz_nextprime(x.get_mpz_t(), x.get_mpz_t());
-  return x;
-}
+  const std::size_t WINDOW = 4096;
+  const std::vector<unsigned long>& primes = small_primes();
 
-//RSA的key生成
-RSAKey rsa_keygen(std::size_t bits) {
-  if (bits < 256) {
-    throw std::invalid_argument("bits too small (use 1024 or 2048).");
-  }
+  // 最高兩位設為 1，保證 p*q 剛好是 bits 位
+  mpz_class x = random_bits(bits);
+  x |= (mpz_class(1) << (bits - 2));
+  x |= 1;
 
-  const std::size_t half = bits / 2;
-  //生成p、q兩個質數
-  mpz_class p = next_prime_of_bits(half);
-  mpz_class q = next_prime_of_bits(bits - half);
+  std::vector<char> sieve(WINDOW);
+  while (true) {
+    std::fill(sieve.begin(), sieve.end(), 0);
+    for (unsigned long pr : primes) {
+      // 找出第一個 i 使 x + 2i ≡ 0 (mod pr)：i ≡ -r * 2^{-1} (mod pr)
+      unsigned long r = mpz_fdiv_ui(x.get_mpz_t(), pr);
+      unsigned long i = ((pr - r) % pr) * ((pr + 1) / 2) % pr;
+      for (; i < WINDOW; i += pr) sieve[i] = 1;
+    }
 
-  // 避免 p == q（雖然機率低）
-  while (p == q) {
-    q = next_prime_of_bits(bits - half);
+    mpz_class cand;
+    for (std::size_t i = 0; i < WINDOW; i++) {
+      if (sieve[i]) continue;
+      cand = x + 2 * static_cast<unsigned long>(i);
+      if (mpz_probab_prime_p(cand.get_mpz_t(), 25) > 0) return cand;
+    }
+    x += 2 * static_cast<unsigned long>(WINDOW);
   }
+}
 
+//由 p、q 組出完整金鑰
+static RSAKey build_key(const mpz_class& p, const mpz_class& q) {
   mpz_class n   = p * q;
   //phi=φ(n)
   mpz_class phi = (p - 1) * (q - 1);
@@ -73,22 +115,412 @@ RSAKey rsa_keygen(std::size_t bits) {
   key.n = n;
   key.e = e;
   key.d = d;
+  key.p = p;
+  key.q = q;
+  rsa_fill_crt(key);
   return key;
 }
 
-mpz_class rsa_encrypt(const mpz_class& m, const RSAKey& key) {
+static void check_bits(std::size_t bits) {
+  if (bits < RSA_MIN_BITS) {
+    throw std::invalid_argument("bits too small (use 1024 or 2048).");
+  }
+}
+
+// 單執行緒版本，rsa_keygen_batch 中每個工作用這個，避免再開執行緒
+static RSAKey keygen_serial(std::size_t bits) {
+  const std::size_t half = bits / 2;
+  mpz_class p = next_prime_of_bits(half);
+  mpz_class q = next_prime_of_bits(bits - half);
+
+  // 避免 p == q（雖然機率低）
+  while (p == q) {
+    q = next_prime_of_bits(bits - half);
+  }
+  return build_key(p, q);
+}
+
+//RSA的key生成
+RSAKey rsa_keygen(std::size_t bits) {
+  check_bits(bits);
+
+  const std::size_t half = bits / 2;
+  //生成p、q兩個質數：q 在另一條執行緒搜尋，p 在目前執行緒搜尋
+  std::future<mpz_class> qFuture = std::async(std::launch::async, next_prime_of_bits, bits - half);
+  mpz_class p = next_prime_of_bits(half);
+  mpz_class q = qFuture.get();
+
+  // 避免 p == q（雖然機率低）
+  while (p == q) {
+    q = next_prime_of_bits(bits - half);
+  }
+  return build_key(p, q);
+}
+
+std::vector<RSAKey> rsa_keygen_batch(std::size_t count, std::size_t bits) {
+  check_bits(bits);
+
+  std::vector<RSAKey> keys(count);
+  std::vector<std::exception_ptr> errors(count);
+  ThreadPool pool;
+  for (std::size_t i = 0; i < count; i++) {
+    pool.submit([&keys, &errors, i, bits] {
+      // ThreadPool 的工作不能拋出例外，先記下來等全部完成再丟出
+      try {
+        keys[i] = keygen_serial(bits);
+      } catch (...) {
+        errors[i] = std::current_exception();
+      }
+    });
+  }
+  pool.wait();
+
+  for (const std::exception_ptr& err : errors) {
+    if (err) std::rethrow_exception(err);
+  }
+  return keys;
+}
+
+void rsa_fill_crt(RSAKey& key) {
+  if (key.p * key.q != key.n) {
+    throw std::invalid_argument("p * q must equal n.");
+  }
+  key.dP = key.d % (key.p - 1);
+  key.dQ = key.d % (key.q - 1);
+  if (mpz_invert(key.qInv.get_mpz_t(), key.q.get_mpz_t(), key.p.get_mpz_t()) == 0) {
+    throw std::runtime_error("mpz_invert failed: q has no inverse mod p.");
+  }
+}
+
+// p * q == n，且 dP / dQ / qInv 都與 d、p、q 一致（p、q <= 1 時 p - 1 為 0，不能拿來取餘數）
+static bool crt_consistent(const RSAKey& key) {
+  if (key.p <= 1 || key.q <= 1 || key.p * key.q != key.n) return false;
+  return (key.qInv * key.q) % key.p == 1 &&
+         key.dP == key.d % (key.p - 1) && key.dQ == key.d % (key.q - 1);
+}
+
+RSAContext rsa_context(const RSAKey& key) {
+  RSAContext ctx;
+  ctx.key = key;
+  ctx.bits = mpz_sizeinbase(key.n.get_mpz_t(), 2);
+
+  if (key.has_crt()) {
+    if (!crt_consistent(key)) {
+      throw std::invalid_argument("inconsistent CRT parameters.");
+    }
+    ctx.crt = true;
+    // 2048 bits 以上的半邊模指數要數百微秒，開一條執行緒的成本相對很小
+    ctx.parallel_crt = ctx.bits >= 2048 && ThreadPool::defaultThreadCount() > 1;
+  }
+  return ctx;
+}
+
+static void check_message(const mpz_class& m, const mpz_class& n) {
   if (m < 0) throw std::invalid_argument("message must be non-negative.");
-  if (m >= key.n) throw std::invalid_argument("message must be < n.");
-  mpz_class c;
+  if (m >= n) throw std::invalid_argument("message must be < n.");
+}
+
+static void check_cipher(const mpz_class& c, const mpz_class& n) {
+  if (c < 0) throw std::invalid_argument("cipher must be non-negative.");
+  if (c >= n) throw std::invalid_argument("cipher must be < n.");
+}
+
+static mpz_class powm(const mpz_class& base, const mpz_class& exp, const mpz_class& mod) {
+  mpz_class r;
   //mpz_powm為GMP的mod指數運算
-  mpz_powm(c.get_mpz_t(), m.get_mpz_t(), key.e.get_mpz_t(), key.n.get_mpz_t());
-  return c;
+  mpz_powm(r.get_mpz_t(), base.get_mpz_t(), exp.get_mpz_t(), mod.get_mpz_t());
+  return r;
+}
+
+// CRT：m1 = c^dP mod p、m2 = c^dQ mod q，
+// 再以 Garner 公式合併 m = m2 + q * (qInv * (m1 - m2) mod p)
+// 兩次模指數的模數與指數都只有一半長度，約比直接 c^d mod n 快 3~4 倍；
+// parallel 為 true 時 m2 在另一條執行緒上計算
+static mpz_class crt_decrypt(const mpz_class& c, const RSAKey& key, bool parallel) {
+  mpz_class m1, m2;
+  if (parallel) {
+    std::future<mpz_class> half = std::async(std::launch::async, powm, std::cref(c), std::cref(key.dQ), std::cref(key.q));
+    m1 = powm(c, key.dP, key.p);
+    m2 = half.get();
+  } else {
+    m1 = powm(c, key.dP, key.p);
+    m2 = powm(c, key.dQ, key.q);
+  }
+
+  mpz_class h = key.qInv * (m1 - m2);
+  mpz_mod(h.get_mpz_t(), h.get_mpz_t(), key.p.get_mpz_t()); // mpz_mod 結果必為非負
+  return m2 + h * key.q;
+}
+
+mpz_class rsa_encrypt(const mpz_class& m, const RSAKey& key) {
+  StageTimer timer(Metrics::Stage::RsaEncrypt);
+  check_message(m, key.n);
+  return powm(m, key.e, key.n);
+}
+
+mpz_class rsa_encrypt(const mpz_class& m, const RSAContext& ctx) {
+  StageTimer timer(Metrics::Stage::RsaEncrypt);
+  check_message(m, ctx.key.n);
+  return powm(m, ctx.key.e, ctx.key.n);
 }
 
 mpz_class rsa_decrypt(const mpz_class& c, const RSAKey& key) {
-  if (c < 0) throw std::invalid_argument("cipher must be non-negative.");
-  if (c >= key.n) throw std::invalid_argument("cipher must be < n.");
-  mpz_class m;
-  mpz_powm(m.get_mpz_t(), c.get_mpz_t(), key.d.get_mpz_t(), key.n.get_mpz_t());
-  return m;
+  StageTimer timer(Metrics::Stage::RsaDecrypt);
+  check_cipher(c, key.n);
+  if (!key.has_crt()) return powm(c, key.d, key.n);
+  return crt_decrypt(c, key, false);
+}
+
+mpz_class rsa_decrypt(const mpz_class& c, const RSAContext& ctx) {
+  StageTimer timer(Metrics::Stage::RsaDecrypt);
+  check_cipher(c, ctx.key.n);
+  if (!ctx.crt) return powm(c, ctx.key.d, ctx.key.n);
+  return crt_decrypt(c, ctx.key, ctx.parallel_crt);
+}
+
+std::vector<mpz_class> rsa_decrypt_batch(const std::vector<mpz_class>& ciphers, const RSAKey& key) {
+  return rsa_decrypt_batch(ciphers, rsa_context(key));
+}
+
+std::vector<mpz_class> rsa_decrypt_batch(const std::vector<mpz_class>& ciphers, const RSAContext& ctx) {
+  for (const mpz_class& c : ciphers) check_cipher(c, ctx.key.n);
+
+  const std::size_t count = ciphers.size();
+  std::vector<mpz_class> plains(count);
+  if (count == 0) return plains;
+
+  // 批次本身已經分散到所有執行緒，單筆解密不再拆成兩條執行緒
+  const RSAKey& key = ctx.key;
+  const bool crt = ctx.crt;
+  auto decrypt_one = [&key, crt](const mpz_class& c) {
+    StageTimer timer(Metrics::Stage::RsaDecrypt);
+    return crt ? crt_decrypt(c, key, false) : powm(c, key.d, key.n);
+  };
+
+  // 每個工作處理一段連續的 cipher，段數約為執行緒數的 4 倍，讓 work-stealing 有東西可偷
+  const unsigned threads = ThreadPool::defaultThreadCount();
+  const std::size_t span = std::max<std::size_t>(1, count / (4 * static_cast<std::size_t>(threads)));
+  if (threads == 1 || count <= span) {
+    for (std::size_t i = 0; i < count; i++) plains[i] = decrypt_one(ciphers[i]);
+    return plains;
+  }
+
+  ThreadPool pool(threads);
+  for (std::size_t begin = 0; begin < count; begin += span) {
+    const std::size_t end = std::min(count, begin + span);
+    pool.submit([&ciphers, &plains, &decrypt_one, begin, end] {
+      // 範圍已在上面檢查過，不會拋出例外
+      for (std::size_t i = begin; i < end; i++) plains[i] = decrypt_one(ciphers[i]);
+    });
+  }
+  pool.wait();
+  return plains;
+}
+
+// ---- 二進位檔案格式 ----
+static const char KEY_MAGIC[4]     = {'R', 'S', 'A', 'K'};
+static const char WRAPPED_MAGIC[4] = {'R', 'S', 'A', 'W'};
+static const unsigned char FORMAT_VERSION = 1;
+static const unsigned char FLAG_CRT = 0x01;
+// 單一整數長度上限（遠大於 16384-bit 金鑰），避免損壞的檔案要求配置巨大記憶體
+static const uint32_t MAX_MPZ_BYTES = 1u << 16;
+
+static void write_u32(std::ostream& out, uint32_t v) {
+  unsigned char b[4] = {
+    static_cast<unsigned char>(v >> 24), static_cast<unsigned char>(v >> 16),
+    static_cast<unsigned char>(v >> 8),  static_cast<unsigned char>(v)
+  };
+  out.write(reinterpret_cast<const char*>(b), 4);
+}
+
+static bool read_u32(std::istream& in, uint32_t& v) {
+  unsigned char b[4];
+  if (!in.read(reinterpret_cast<char*>(b), 4)) return false;
+  v = (uint32_t(b[0]) << 24) | (uint32_t(b[1]) << 16) | (uint32_t(b[2]) << 8) | uint32_t(b[3]);
+  return true;
+}
+
+std::vector<unsigned char> rsa_mpz_to_bytes(const mpz_class& x) {
+  std::vector<unsigned char> buf((mpz_sizeinbase(x.get_mpz_t(), 2) + 7) / 8);
+  std::size_t count = 0;
+  // order = 1：最高位的 byte 在前（big-endian），x == 0 時 count 為 0
+  mpz_export(buf.data(), &count, 1, 1, 1, 0, x.get_mpz_t());
+  buf.resize(count);
+  return buf;
+}
+
+mpz_class rsa_mpz_from_bytes(const std::vector<unsigned char>& bytes) {
+  mpz_class x;
+  mpz_import(x.get_mpz_t(), bytes.size(), 1, 1, 1, 0, bytes.data());
+  return x;
+}
+
+void rsa_write_mpz(std::ostream& out, const mpz_class& x) {
+  std::vector<unsigned char> buf = rsa_mpz_to_bytes(x);
+  write_u32(out, static_cast<uint32_t>(buf.size()));
+  out.write(reinterpret_cast<const char*>(buf.data()), static_cast<std::streamsize>(buf.size()));
+}
+
+bool rsa_read_mpz(std::istream& in, mpz_class& x) {
+  uint32_t count;
+  if (!read_u32(in, count) || count > MAX_MPZ_BYTES) return false;
+  std::vector<unsigned char> buf(count);
+  if (count > 0 && !in.read(reinterpret_cast<char*>(buf.data()), count)) return false;
+  x = rsa_mpz_from_bytes(buf);
+  return true;
+}
+
+// 讀取 4-byte magic；不符合時把讀取位置倒回開頭，讓呼叫端改用文字格式解析
+static bool match_magic(std::istream& in, const char magic[4]) {
+  char head[4];
+  if (in.read(head, 4) && std::memcmp(head, magic, 4) == 0) return true;
+  in.clear();
+  in.seekg(0);
+  return false;
+}
+
+bool rsa_save_key(const std::string& path, const RSAKey& key) {
+  std::ofstream out(path, std::ios::binary);
+  if (!out) return false;
+
+  const bool crt = key.has_crt();
+  const char header[4] = {
+    static_cast<char>(FORMAT_VERSION), static_cast<char>(crt ? FLAG_CRT : 0), 0, 0
+  };
+  out.write(KEY_MAGIC, 4);
+  out.write(header, 4);
+  rsa_write_mpz(out, key.n);
+  rsa_write_mpz(out, key.e);
+  rsa_write_mpz(out, key.d);
+  if (crt) {
+    rsa_write_mpz(out, key.p);
+    rsa_write_mpz(out, key.q);
+    rsa_write_mpz(out, key.dP);
+    rsa_write_mpz(out, key.dQ);
+    rsa_write_mpz(out, key.qInv);
+  }
+  return static_cast<bool>(out.flush());
+}
+
+bool rsa_load_key(const std::string& path, RSAKey& key) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) return false;
+
+  RSAKey k;
+  if (match_magic(in, KEY_MAGIC)) {
+    char header[4];
+    if (!in.read(header, 4) || header[0] != static_cast<char>(FORMAT_VERSION)) return false;
+    if (!rsa_read_mpz(in, k.n) || !rsa_read_mpz(in, k.e) || !rsa_read_mpz(in, k.d)) return false;
+    if (header[1] & FLAG_CRT) {
+      if (!rsa_read_mpz(in, k.p) || !rsa_read_mpz(in, k.q) || !rsa_read_mpz(in, k.dP) ||
+          !rsa_read_mpz(in, k.dQ) || !rsa_read_mpz(in, k.qInv)) return false;
+    }
+  } else {
+    // 舊版十進位文字格式：n e d，之後可能接著 p q dP dQ qInv
+    if (!(in >> k.n >> k.e >> k.d)) return false;
+    RSAKey crt = k;
+    if (in >> crt.p >> crt.q >> crt.dP >> crt.dQ >> crt.qInv) k = crt;
+  }
+
+  // CRT 參數與 n、d 不一致時清掉，解密改走 c^d mod n，
+  // 直接拿這把金鑰呼叫 rsa_decrypt(c, RSAKey) 的呼叫端也不會得到錯誤的明文
+  if (k.has_crt() && !crt_consistent(k)) {
+    k.p = k.q = k.dP = k.dQ = k.qInv = 0;
+  }
+
+  key = k;
+  return true;
+}
+
+bool rsa_save_wrapped_key(const std::string& path, const mpz_class& c) {
+  std::ofstream out(path, std::ios::binary);
+  if (!out) return false;
+
+  const char header[4] = { static_cast<char>(FORMAT_VERSION), 0, 0, 0 };
+  out.write(WRAPPED_MAGIC, 4);
+  out.write(header, 4);
+  rsa_write_mpz(out, c);
+  return static_cast<bool>(out.flush());
+}
+
+bool rsa_load_wrapped_key(const std::string& path, mpz_class& c) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) return false;
+
+  if (match_magic(in, WRAPPED_MAGIC)) {
+    char header[4];
+    if (!in.read(header, 4) || header[0] != static_cast<char>(FORMAT_VERSION)) return false;
+    return rsa_read_mpz(in, c);
+  }
+
+  // 舊版：十進位字串
+  std::string text;
+  if (!(in >> text)) return false;
+  return c.set_str(text, 10) == 0;
+}
+
+// ---- 自我診斷 ----
+bool rsa_self_test(std::size_t bits, std::size_t rounds) {
+  bool ok = true;
+  auto fail = [&ok](const std::string& what) {
+    std::cerr << "[FAIL] RSA " << what << "\n";
+    ok = false;
+  };
+
+  // 1. 教科書範例：p = 61, q = 53, e = 17, d = 2753，65 -> 2790
+  RSAKey toy;
+  toy.p = 61;
+  toy.q = 53;
+  toy.n = 3233;
+  toy.e = 17;
+  toy.d = 2753;
+  rsa_fill_crt(toy);
+  RSAContext toy_ctx = rsa_context(toy);
+  if (rsa_encrypt(65, toy) != 2790) fail("教科書範例加密結果不符");
+  if (rsa_decrypt(2790, toy_ctx) != 65) fail("教科書範例 CRT 解密結果不符");
+  RSAKey toy_plain = toy;
+  toy_plain.p = toy_plain.q = toy_plain.dP = toy_plain.dQ = toy_plain.qInv = 0;
+  if (rsa_decrypt(2790, toy_plain) != 65) fail("教科書範例非 CRT 解密結果不符");
+
+  // 2. 新產生的金鑰：參數必須自洽
+  RSAKey key = rsa_keygen(bits);
+  RSAContext ctx = rsa_context(key);
+  mpz_class phi = (key.p - 1) * (key.q - 1);
+  if (key.p * key.q != key.n) fail("n != p * q");
+  if (ctx.bits != bits) fail("n 的位元數不等於 " + std::to_string(bits));
+  if ((key.e * key.d) % phi != 1) fail("e * d mod phi != 1");
+  if (!ctx.crt) fail("新金鑰沒有啟用 CRT");
+
+  // 3. 隨機訊息：所有解密路徑結果相同，且能還原
+  RSAKey no_crt = key;
+  no_crt.p = no_crt.q = no_crt.dP = no_crt.dQ = no_crt.qInv = 0;
+  RSAContext serial_ctx = ctx, parallel_ctx = ctx;
+  serial_ctx.parallel_crt = false;
+  parallel_ctx.parallel_crt = true;
+
+  std::vector<mpz_class> messages(rounds), ciphers(rounds);
+  for (std::size_t i = 0; i < rounds && ok; i++) {
+    // 包含 0、1、n-1 等邊界值
+    mpz_class m;
+    if (i == 0) m = 0;
+    else if (i == 1) m = 1;
+    else if (i == 2) m = key.n - 1;
+    else m = global_rng().get_z_range(key.n);
+
+    mpz_class c = rsa_encrypt(m, ctx);
+    if (c != rsa_encrypt(m, key)) fail("RSAKey 與 RSAContext 加密結果不同");
+    if (rsa_decrypt(c, serial_ctx) != m) fail("CRT 解密無法還原");
+    if (rsa_decrypt(c, parallel_ctx) != m) fail("平行 CRT 解密無法還原");
+    if (rsa_decrypt(c, no_crt) != m) fail("非 CRT 解密無法還原");
+    if (rsa_mpz_from_bytes(rsa_mpz_to_bytes(c)) != c) fail("mpz <-> bytes 轉換無法還原");
+    messages[i] = m;
+    ciphers[i] = c;
+  }
+  if (ok && rsa_decrypt_batch(ciphers, ctx) != messages) fail("批次解密結果與逐一解密不同");
+
+  if (ok) {
+    std::cout << "[PASS] RSA：教科書範例與 " << bits << " bits 金鑰 " << rounds
+              << " 組隨機訊息 (CRT / 非 CRT / 平行 CRT / 批次) 一致。\n";
+  }
+  return ok;
 }
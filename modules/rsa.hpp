@@ -3,23 +3,93 @@
 
 #include <gmpxx.h>
 #include <cstddef>
+#include <iosfwd>
+#include <string>
+#include <vector>
 
 struct RSAKey {
   mpz_class n;  // modulus
   mpz_class e;  // public exponent
   mpz_class d;  // private exponent
+
+  // CRT 參數（舊金鑰檔沒有這些欄位時為 0，解密改走 c^d mod n）
+  mpz_class p;     // 質因數 p
+  mpz_class q;     // 質因數 q
+  mpz_class dP;    // d mod (p-1)
+  mpz_class dQ;    // d mod (q-1)
+  mpz_class qInv;  // q^{-1} mod p
+
+  bool has_crt() const { return p != 0 && q != 0; }
+};
+
+// 由 RSAKey 建立一次、之後重複使用的運算環境：
+// 建立時驗證 CRT 參數並決定解密策略，之後每次運算不必再檢查或推導。
+// 模指數本身交給 mpz_powm（內部已是 Montgomery 乘法 + sliding window），
+// 視窗表與 base 有關，每次運算都得重建，無法預先算好。
+struct RSAContext {
+  RSAKey key;
+  std::size_t bits = 0;       // n 的位元數
+  bool crt = false;           // CRT 參數齊全且驗證通過
+  bool parallel_crt = false;  // 單次解密時兩個 CRT 半邊分到兩條執行緒（大金鑰且多核心時）
 };
 
+// 建立 RSAContext；CRT 參數不一致時拋出 std::invalid_argument
+RSAContext rsa_context(const RSAKey& key);
+
+// rsa_keygen 接受的最小位元數，更小時拋出 std::invalid_argument
+constexpr std::size_t RSA_MIN_BITS = 256;
+
 // 產生 RSA 金鑰（bits 建議 1024/2048）
+// p、q 分別在兩條執行緒上搜尋
 RSAKey rsa_keygen(std::size_t bits);
 
+// 一次產生 count 組金鑰，分散到執行緒池上（每組金鑰內部不再開執行緒）
+std::vector<RSAKey> rsa_keygen_batch(std::size_t count, std::size_t bits);
+
 // RSA: c = m^e mod n
 mpz_class rsa_encrypt(const mpz_class& m, const RSAKey& key);
+mpz_class rsa_encrypt(const mpz_class& m, const RSAContext& ctx);
 
-// RSA: m = c^d mod n
+// RSA: m = c^d mod n（有 CRT 參數時改用兩次半長度的模指數再合併）
 mpz_class rsa_decrypt(const mpz_class& c, const RSAKey& key);
+mpz_class rsa_decrypt(const mpz_class& c, const RSAContext& ctx);
+
+// 批次解密（例如大量被 RSA 包裝的 session key），分散到執行緒池上；
+// 結果順序與輸入相同，任何一個 cipher 超出範圍時在開始運算前就拋出例外
+std::vector<mpz_class> rsa_decrypt_batch(const std::vector<mpz_class>& ciphers, const RSAKey& key);
+std::vector<mpz_class> rsa_decrypt_batch(const std::vector<mpz_class>& ciphers, const RSAContext& ctx);
+
+// 由 p、q、d 補上 dP、dQ、qInv（p*q 必須等於 n）
+void rsa_fill_crt(RSAKey& key);
+
+// ---- 二進位檔案格式 ----
+// 整數：4-byte big-endian 長度 + big-endian 位元組（mpz_export/mpz_import），
+// 免去大數與十進位字串之間的轉換。
+// 金鑰檔      : "RSAK" | version(1) | flags(1, bit0 = 含 CRT) | 保留(2) | n e d [p q dP dQ qInv]
+// 包裝的金鑰檔: "RSAW" | version(1) | 保留(3) | c
+void rsa_write_mpz(std::ostream& out, const mpz_class& x);
+bool rsa_read_mpz(std::istream& in, mpz_class& x);
+
+// 包裝金鑰 <-> big-endian bytes（長度由外層格式記錄，例如 Serpent 容器標頭）
+std::vector<unsigned char> rsa_mpz_to_bytes(const mpz_class& x);
+mpz_class rsa_mpz_from_bytes(const std::vector<unsigned char>& bytes);
+
+// 以二進位格式寫入金鑰，失敗回傳 false
+bool rsa_save_key(const std::string& path, const RSAKey& key);
+// 讀取金鑰：自動辨識二進位格式與舊版十進位文字格式（3 行，或 8 行含 CRT）
+// CRT 參數與 n、d 不一致時會被清成 0（仍可解密，只是不走 CRT）
+bool rsa_load_key(const std::string& path, RSAKey& key);
+
+// 被 RSA 包裝的 session key；讀取時同樣接受舊版的十進位文字檔
+bool rsa_save_wrapped_key(const std::string& path, const mpz_class& c);
+bool rsa_load_wrapped_key(const std::string& path, mpz_class& c);
 
 // 工具：把位元字串/小型 key 轉成 mpz_class（可用於 session key）
 mpz_class random_bits(std::size_t bits);
 
+// 自我診斷：教科書小金鑰的已知答案，以及產生一組 bits 位元金鑰後做 rounds 次隨機一致性檢查
+// （金鑰參數、加解密來回、CRT / 非 CRT / 平行 CRT / 批次解密結果相同、bytes 轉換）。
+// 全部通過回傳 true，失敗項目印到 std::cerr
+bool rsa_self_test(std::size_t bits, std::size_t rounds);
+
 #endif
@@ -3,14 +3,44 @@
 
 #include <string>
 #include <vector>
+#include <cstddef>  // 為了使用 size_t
 #include <cstdint>  // 為了使用 uint8_t, uint32_t (密碼學必備)
+#include <cstring>  // 為了使用 std::memset
+#include <functional>
 #include <gmpxx.h>  // 為了接收成員 A 的 mpz_class 金鑰
 
+class HMACSHA256;
+class SHA256;
+
 class Serpent {
 public:
+    // --- 區塊格式 ---
+    // Legacy  : 舊版格式，輪函式前後各做一次 transpose，且使用本專案原本的 S1 表格。
+    //           預設值，用來讀寫目前版本已經產生的加密檔。
+    // Standard: 標準 Serpent bitslice 模式，四個 little-endian word 直接當作 bitslice 輸入，
+    //           完全不需要轉置 (使用官方 S1)。與 Legacy 產生的密文不相容。
+    enum class Layout { Legacy, Standard };
+
+    // --- 檔案加密模式 ---
+    // ECB: 每個區塊獨立加密 + PKCS#7 Padding (預設值，與舊版檔案相容)
+    // CTR: 計數器模式，檔案開頭存 16 bytes 隨機 IV，不需要 Padding，
+    //      可依區塊範圍平行處理，也能從任意 offset 解密
+    enum class Mode { ECB, CTR };
+
+    // --- 多區塊運算使用的指令集 (由窄到寬排序) ---
+    enum class Backend { Scalar, SSE2, AVX2, AVX512 };
+
     // --- 建構子與解構子 ---
-    Serpent() { std::memset(subkeys, 0, sizeof(subkeys)); }
-    ~Serpent() { std::memset(subkeys, 0, sizeof(subkeys)); }
+    Serpent() : layout(Layout::Legacy), mode(Mode::ECB), backend(detectBackend()), chunkSize(DEFAULT_CHUNK_SIZE),
+                authenticated(false), verbose(false), hasKey(false) {
+        setThreadCount(0);
+        std::memset(subkeys, 0, sizeof(subkeys));
+        std::memset(masterKey, 0, sizeof(masterKey));
+    }
+    ~Serpent() {
+        std::memset(subkeys, 0, sizeof(subkeys));
+        std::memset(masterKey, 0, sizeof(masterKey));
+    }
 
     // --- 給成員 C 呼叫的主要介面 ---
 
@@ -20,31 +50,205 @@ public:
 
     // 2. 加密檔案
     // 功能：讀取 inputFile，加密後寫入 outputFile，string代表路徑
-    // 回傳：true 代表成功，false 代表檔案讀寫失敗
-    bool encryptFile(const std::string& inputFile, const std::string& outputFile);
+    //       以 chunkSize 為單位串流處理，記憶體用量固定，與檔案大小無關
+    // 回傳：true 代表成功，false 代表檔案讀寫失敗，或 inputFile 與 outputFile 是同一個檔案
+    //       (串流處理邊讀邊寫，不能原地加密；decryptFile 亦同)
+    // plainHash / cipherHash (可為 nullptr)：在同一次讀寫中順便計算明文 / 整個加密檔的 SHA-256，
+    //       不必再讀一次檔案；呼叫端之後自行呼叫 digest()。
+    //       cipherHash 的結果與對加密檔另外計算 SHA-256 相同 (包含標頭、驗證碼與索引)。
+    bool encryptFile(const std::string& inputFile, const std::string& outputFile,
+                     SHA256* plainHash = nullptr, SHA256* cipherHash = nullptr);
 
     // 3. 解密檔案 (驗證用)
     // 功能：讀取加密檔，解密後還原成原始檔案，string代表路徑
-    bool decryptFile(const std::string& inputFile, const std::string& outputFile);
+    //       容器檔依標頭的 mode / layout 解密；舊版檔案依目前的 mode 解讀
+    //       plainHash / cipherHash 同 encryptFile (明文為解密後的輸出，密文為輸入的加密檔)
+    bool decryptFile(const std::string& inputFile, const std::string& outputFile,
+                     SHA256* plainHash = nullptr, SHA256* cipherHash = nullptr);
+
+    // --- 單一檔案容器 ---
+    // 檔案 = [標頭][密文][驗證碼][chunk 索引]，解密所需的資訊都在標頭，不再需要另外的 session.key：
+    //   magic "SRPC" | version(1) | cipher id(1) | mode(1) | layout(1) | flags(4) | chunkSize(4)
+    //   | 明文長度(8) | nonce(16) | 包裝金鑰長度(4) | 包裝金鑰
+    // 整數皆為 big-endian；包裝金鑰對 Serpent 而言是不透明的 bytes (由呼叫端用 RSA 包裝/解開)。
+    // flags bit0 (FLAG_CHUNK_INDEX)：密文後面附有 chunk 索引，見 ChunkIndexEntry。
+    // flags bit1 (FLAG_HMAC)       ：密文後面緊接 32-byte HMAC-SHA256 (encrypt-then-MAC)，
+    //                                涵蓋標頭與全部密文，僅用於 CTR。
+    static constexpr uint32_t FLAG_CHUNK_INDEX = 1u << 0;
+    static constexpr uint32_t FLAG_HMAC        = 1u << 1;
+
+    struct ContainerHeader {
+        uint8_t version;
+        Mode mode;
+        Layout layout;
+        uint32_t flags;
+        uint32_t chunkSize;
+        uint64_t plainSize;
+        uint8_t nonce[16];                // CTR 的 IV (ECB 為全 0)
+        std::vector<uint8_t> wrappedKey;
+        uint64_t dataOffset;              // 密文在檔案中的起點 (= 標頭長度)
+    };
+
+    // 以目前的 mode / layout / chunkSize 加密成容器檔，wrappedKey 原樣寫進標頭
+    bool encryptFile(const std::string& inputFile, const std::string& outputFile,
+                     const std::vector<uint8_t>& wrappedKey,
+                     SHA256* plainHash = nullptr, SHA256* cipherHash = nullptr);
+
+    // 容器檔的 encrypt-then-MAC (只適用於 CTR)：
+    // 加密時在同一個串流迴圈中對密文計算 HMAC-SHA256，不需要再讀一次檔案；
+    // 解密時先寫到暫存檔 (outputFile + ".part")，驗證碼正確才改名為 outputFile，
+    // 不符時刪除暫存檔並回傳 false，竄改或金鑰錯誤的明文不會被釋出。
+    // MAC 金鑰由 session key 導出，與加密金鑰不同。
+    void setAuthenticated(bool on) { authenticated = on; }
+    bool getAuthenticated() const { return authenticated; }
+    // 檢查 magic / 讀取標頭 (解密前先取出包裝金鑰)
+    static bool isContainer(const std::string& file);
+    static bool readContainerHeader(const std::string& file, ContainerHeader& header);
+
+    // --- chunk 索引 (容器檔尾端) ---
+    // 每個 chunk 一筆：明文 offset(8) | 明文長度(4) | 密文 offset(8, 從檔案開頭算) | 密文長度(4)
+    // 之後是 chunk 數(8) | 索引起點(8) | magic "SRPI"，從檔尾往回讀即可找到索引。
+    struct ChunkIndexEntry {
+        uint64_t plainOffset;
+        uint32_t plainLen;
+        uint64_t cipherOffset;
+        uint32_t cipherLen;               // ECB 的最後一個 chunk 含 Padding
+    };
+    static bool readChunkIndex(const std::string& file, const ContainerHeader& header,
+                               std::vector<ChunkIndexEntry>& index);
+
+    // 只解密明文 [offset, offset + length) 這一段 (超過檔尾的部分會被截掉)，結果放在 out。
+    // 依索引找出涵蓋的 chunk，只讀取並解密這些 chunk 內需要的區塊，
+    // 花費與範圍大小成正比，與檔案大小無關。需要有 chunk 索引的容器檔。
+    // 含 HMAC (FLAG_HMAC) 的容器檔一律回傳 false：驗證碼涵蓋整個檔案，只讀部分密文無法驗證，
+    // 在每個 chunk 各自附上驗證碼之前不提供未驗證的部分明文，請改用 decryptFile。
+    bool decryptRange(const std::string& file, uint64_t offset, uint64_t length, std::vector<uint8_t>& out);
+
+    // 串流加解密每次處理的資料量 (預設 1 MiB，會向下取整為 16 的倍數，限制在 16 bytes ~ MAX_CHUNK_SIZE)
+    // 上限讓值一定放得進容器標頭的 32-bit chunkSize 欄位，也避免每個 chunk 配置過大的緩衝區
+    static constexpr size_t DEFAULT_CHUNK_SIZE = 1 << 20;
+    static constexpr size_t MAX_CHUNK_SIZE = 1 << 30;
+    void setChunkSize(size_t bytes);
+    size_t getChunkSize() const { return chunkSize; }
+
+    // 檔案加解密使用的執行緒數 (預設 std::thread::hardware_concurrency()，0 代表預設值)
+    // 各 chunk 由 work-stealing 執行緒池平行處理，輸出順序不變；
+    // 實際建立的執行緒數不超過檔案的 chunk 數與硬體執行緒數
+    void setThreadCount(unsigned n);
+    unsigned getThreadCount() const { return threadCount; }
+
+    // 4. 切換區塊格式 (可在 setKey 前後呼叫，已設定的金鑰會自動重新擴展)
+    void setLayout(Layout newLayout);
+    Layout getLayout() const { return layout; }
 
-    void runComponentTest();
+    // 5. 多區塊加密/解密
+    // 功能：處理 nblocks 個連續的 16-byte 區塊 (每個區塊為 4 個 little-endian word)，
+    //       依 CPU 一次平行處理 4 (SSE2) / 8 (AVX2) / 16 (AVX-512) 個區塊，
+    //       不足一組的尾端退回 scalar encryptBlock。in 與 out 可以是同一塊記憶體。
+    void encryptBlocks(const uint8_t* in, uint8_t* out, size_t nblocks) const;
+    void decryptBlocks(const uint8_t* in, uint8_t* out, size_t nblocks) const;
+
+    // ECB 檔案加解密時在 std::cout 印出前 32 bytes 密文與偵測到的 Padding 長度 (除錯用，預設關閉)
+    void setVerbose(bool on) { verbose = on; }
+    bool getVerbose() const { return verbose; }
+
+    // 切換檔案加密模式 (encryptFile / decryptFile 依此決定格式)
+    void setMode(Mode newMode) { mode = newMode; }
+    Mode getMode() const { return mode; }
+
+    // CTR 模式核心：從明文/密文的第 offset 個 byte 開始處理 len bytes (加密與解密相同)
+    // 只讀取已擴展的 subkeys，多條執行緒可以共用同一個物件處理不重疊的範圍。
+    // in 與 out 可以是同一塊記憶體。
+    void ctrCrypt(const uint8_t iv[16], uint64_t offset, const uint8_t* in, uint8_t* out, size_t len) const;
+
+    // 依檔案順序接收資料的 callback (SHA-256、HMAC 等)，檔案加解密時只在呼叫端執行緒上呼叫
+    typedef std::function<void(const uint8_t*, size_t)> ByteSink;
+
+    // 同上面的 encryptFile / decryptFile，但明文依檔案順序交給 onPlain (例如 SHA256Multi 的某個 lane)，
+    // 不限定為單一 SHA256；onPlain 可為空
+    bool encryptFile(const std::string& inputFile, const std::string& outputFile,
+                     const std::vector<uint8_t>& wrappedKey, const ByteSink& onPlain, SHA256* cipherHash);
+    bool decryptFile(const std::string& inputFile, const std::string& outputFile,
+                     const ByteSink& onPlain, SHA256* cipherHash);
+
+    // 6. 指令集選擇
+    // detectBackend: 以 CPUID 偵測目前 CPU 能用的最寬 backend (預設值)
+    // setBackend   : 強制使用較窄的 backend (例如測試或比對用)，超出 CPU 能力時自動降級
+    static Backend detectBackend();
+    static const char* backendName(Backend b);
+    void setBackend(Backend b);
+    Backend getBackend() const { return backend; }
+
+    // --- 自我診斷 (全部通過時回傳 true；通過的項目印到 std::cout，失敗的印到 std::cerr) ---
+    // runComponentTest   : 轉置、線性變換、S-Box 電路與查表 (依目前的 layout)
+    // runKnownAnswerTest : 官方測試向量 (Standard)，以及鎖定 Legacy 格式的固定向量，加密與解密皆比對
+    // runDifferentialTest: 隨機金鑰與資料，比對每個 SIMD backend 與 scalar 的 encryptBlocks /
+    //                      decryptBlocks / ctrCrypt，至少處理 blocks 個區塊 (每種 layout、每個 backend)；
+    //                      失敗時印出 seed，以相同 seed 重跑可重現
+    // runContainerTest   : 在 tempDir (空字串為系統暫存目錄) 寫出暫存檔，檢查容器檔 ECB / CTR / CTR+HMAC 的來回、
+    //                      竄改密文後 HMAC 驗證失敗且不留下明文，以及 decryptRange 與明文切片一致；結束時刪除暫存檔
+    bool runComponentTest();
+    static bool runKnownAnswerTest();
+    static bool runDifferentialTest(uint64_t blocks, uint64_t seed);
+    static bool runContainerTest(uint64_t seed, const std::string& tempDir = "");
 
 private:
     // --- Serpent 內部核心變數 ---
     // 儲存擴展後的 33 組輪金鑰 (每組 128 bits = 4 * 32 bits)
     uint32_t subkeys[33][4];
 
+    // 目前的區塊格式，以及切換格式時重新擴展用的 256-bit 主金鑰
+    Layout layout;
+    Mode mode;
+    Backend backend;
+    size_t chunkSize;
+    unsigned threadCount;
+    bool authenticated;
+    bool verbose;
+    bool hasKey;
+    uint8_t masterKey[32];
+
     // --- Serpent 內部核心函式 (不給外部呼叫) ---
 
+    // 直接以 32 bytes 設定主金鑰 (setKey 由 mpz_class 轉換後呼叫；測試向量也從這裡進入)
+    void setKeyBytes(const uint8_t key[32]);
+
     // 金鑰擴展 (Key Schedule): 將 256-bit 主金鑰擴展成 132 個 32-bit 字組
     void keySchedule(const std::vector<uint8_t>& key);
 
+    // 各模式的檔案加解密 (由 encryptFile / decryptFile 呼叫)
+    // makePrefix: 開啟輸入檔後，以實際要加密的明文長度 (與加密時使用的同一個 mmap / ifstream 量得) 呼叫一次，
+    //             回傳寫在密文前面的資料 (容器標頭或舊版 CTR 的 IV)；標頭記錄的長度因此一定與密文一致
+    // dataOffset: 密文在輸入檔中的起點
+    // expectedSize: 標頭記錄的明文長度，用來檢查檔案是否完整，並決定密文在哪裡結束
+    //               (後面可能接著 chunk 索引)；舊版檔案為 UNKNOWN_SIZE，密文到檔尾為止
+    // onInput / onOutput: 依檔案順序收到讀入的資料 / 寫出的資料 (不含 prefix，可為空)
+    static constexpr uint64_t UNKNOWN_SIZE = ~0ULL;
+    typedef std::function<std::vector<uint8_t>(uint64_t plainSize)> PrefixBuilder;
+    bool encryptFileECB(const std::string& inputFile, const std::string& outputFile,
+                        const PrefixBuilder& makePrefix, const ByteSink& onInput, const ByteSink& onOutput);
+    bool decryptFileECB(const std::string& inputFile, const std::string& outputFile,
+                        uint64_t dataOffset, uint64_t expectedSize, const ByteSink& onInput, const ByteSink& onOutput);
+    bool encryptFileCTR(const std::string& inputFile, const std::string& outputFile,
+                        const uint8_t iv[16], const PrefixBuilder& makePrefix,
+                        const ByteSink& onInput, const ByteSink& onOutput);
+    bool decryptFileCTR(const std::string& inputFile, const std::string& outputFile,
+                        const uint8_t iv[16], uint64_t dataOffset, uint64_t expectedSize,
+                        const ByteSink& onInput, const ByteSink& onOutput);
+
+    // 驗證 HMAC 後才釋出明文的容器解密 (由 decryptFile 呼叫)
+    bool decryptAuthenticated(const std::string& inputFile, const std::string& outputFile,
+                              const ContainerHeader& header, const ByteSink& onPlain, SHA256* cipherHash);
+
+    // 由主金鑰導出 HMAC 金鑰 (HMAC-SHA256(masterKey, 固定標籤))
+    void deriveMacKey(uint8_t out[32]) const;
+
     // 加密一個區塊 (128 bits)
     // input: 4 個 32-bit 整數, output: 4 個 32-bit 整數
-    void encryptBlock(const uint32_t input[4], uint32_t output[4]);
+    void encryptBlock(const uint32_t input[4], uint32_t output[4]) const;
 
     // 解密一個區塊 (128 bits)
-    void decryptBlock(const uint32_t input[4], uint32_t output[4]);
+    void decryptBlock(const uint32_t input[4], uint32_t output[4]) const;
 
     // S-Box 替換與逆替換 (S0~S7)
     // 這裡通常會用到你寫好的 S-box 陣列
@@ -0,0 +1,86 @@
+#include "thread_pool.hpp"
+
+unsigned ThreadPool::defaultThreadCount() {
+    unsigned n = std::thread::hardware_concurrency();
+    return n == 0 ? 1 : n;
+}
+
+ThreadPool::ThreadPool(unsigned threadCount)
+    : queued(0), pending(0), nextQueue(0), stopping(false) {
+    if (threadCount == 0) threadCount = defaultThreadCount();
+
+    for (unsigned i = 0; i < threadCount; i++) {
+        queues.push_back(std::unique_ptr<Queue>(new Queue()));
+    }
+    for (unsigned i = 0; i < threadCount; i++) {
+        workers.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lk(stateMutex);
+        stopping = true;
+    }
+    cvWork.notify_all();
+    for (auto& t : workers) t.join();
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    unsigned id = nextQueue.fetch_add(1) % queues.size();
+    pending++;
+    {
+        // 先遞增再放進佇列：worker 取走工作時才遞減，queued 因此不會小於佇列中的實際數量 (不會下溢)；
+        // 在 stateMutex 內遞增，避免 worker 檢查完條件、還沒睡著前錯過通知
+        std::lock_guard<std::mutex> lk(stateMutex);
+        queued++;
+    }
+    {
+        std::lock_guard<std::mutex> lk(queues[id]->m);
+        queues[id]->tasks.push_back(std::move(task));
+    }
+    cvWork.notify_one();
+}
+
+void ThreadPool::wait() {
+    std::unique_lock<std::mutex> lk(stateMutex);
+    cvDone.wait(lk, [this] { return pending == 0; });
+}
+
+// 先取自己的佇列前端，再從其他佇列尾端偷
+bool ThreadPool::popTask(unsigned id, std::function<void()>& task) {
+    const size_t n = queues.size();
+    for (size_t k = 0; k < n; k++) {
+        Queue& q = *queues[(id + k) % n];
+        std::lock_guard<std::mutex> lk(q.m);
+        if (q.tasks.empty()) continue;
+        if (k == 0) {
+            task = std::move(q.tasks.front());
+            q.tasks.pop_front();
+        } else {
+            task = std::move(q.tasks.back());
+            q.tasks.pop_back();
+        }
+        queued--;
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::workerLoop(unsigned id) {
+    while (true) {
+        std::function<void()> task;
+        if (popTask(id, task)) {
+            task();
+            if (--pending == 0) {
+                std::lock_guard<std::mutex> lk(stateMutex);
+                cvDone.notify_all();
+            }
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lk(stateMutex);
+        cvWork.wait(lk, [this] { return stopping || queued > 0; });
+        if (stopping && queued == 0) return;
+    }
+}
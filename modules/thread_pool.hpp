@@ -0,0 +1,59 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// 簡單的 work-stealing 執行緒池
+// 每個 worker 有自己的工作佇列，submit 以輪流 (round-robin) 方式分配；
+// worker 先從自己佇列的前端取工作，空了就從其他 worker 佇列的尾端偷工作，
+// 避免某條執行緒剛好拿到比較慢的 chunk 時，其他執行緒閒置。
+class ThreadPool {
+public:
+    // threadCount = 0 代表使用 defaultThreadCount()
+    explicit ThreadPool(unsigned threadCount = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // 加入一個工作 (工作本身不應拋出例外)
+    void submit(std::function<void()> task);
+
+    // 等待目前所有已加入的工作完成
+    void wait();
+
+    unsigned size() const { return static_cast<unsigned>(workers.size()); }
+
+    // std::thread::hardware_concurrency()，取不到時回傳 1
+    static unsigned defaultThreadCount();
+
+private:
+    struct Queue {
+        std::mutex m;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    void workerLoop(unsigned id);
+    bool popTask(unsigned id, std::function<void()>& task);
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+
+    std::mutex stateMutex;
+    std::condition_variable cvWork;  // 有新工作或要結束時喚醒 worker
+    std::condition_variable cvDone;  // 所有工作完成時喚醒 wait()
+    std::atomic<size_t> queued;      // 佇列中 (含正要放進佇列) 的工作數，不會小於實際數量
+    std::atomic<size_t> pending;     // 已加入但尚未完成的工作數
+    std::atomic<unsigned> nextQueue;
+    bool stopping;
+};
+
+#endif